@@ -0,0 +1,170 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2022 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#include "deadline_trigger.hpp"
+
+#include <stdexcept>
+#include <string>
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace
+{
+
+int64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Raises the calling thread to SCHED_FIFO while in scope, if permitted.
+class RealtimeScope
+{
+public:
+
+    RealtimeScope() : raised_(false)
+    {
+        if (pthread_getschedparam(pthread_self(), &policy_, &param_) == 0) {
+            struct sched_param rt;
+            rt.sched_priority = sched_get_priority_max(SCHED_FIFO) - 1;
+            raised_ = pthread_setschedparam(pthread_self(), SCHED_FIFO, &rt) == 0;
+        }
+    }
+
+    ~RealtimeScope()
+    {
+        if (raised_) {
+            pthread_setschedparam(pthread_self(), policy_, &param_);
+        }
+    }
+
+private:
+
+    bool raised_;
+    int policy_;
+    struct sched_param param_;
+};
+
+} // namespace
+
+DeadlineTrigger::DeadlineTrigger(int64_t spin_margin_us) :
+    spin_margin_us_(spin_margin_us),
+    last_latency_ns_(0)
+{
+    if ((timer_fd_ = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC)) == -1) {
+        throw std::runtime_error("timerfd_create failed with errno: " + std::to_string(errno));
+    }
+    if ((cancel_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) == -1) {
+        close(timer_fd_);
+        throw std::runtime_error("eventfd failed with errno: " + std::to_string(errno));
+    }
+}
+
+DeadlineTrigger::~DeadlineTrigger()
+{
+    close(timer_fd_);
+    close(cancel_fd_);
+}
+
+int64_t DeadlineTrigger::now()
+{
+    return now_ns() / 1000;
+}
+
+void DeadlineTrigger::cancel()
+{
+    const uint64_t one = 1;
+    if (write(cancel_fd_, &one, sizeof(one)) != sizeof(one)) {
+        throw std::runtime_error("eventfd write failed with errno: " + std::to_string(errno));
+    }
+}
+
+void DeadlineTrigger::reset()
+{
+    consume_cancel();
+}
+
+bool DeadlineTrigger::consume_cancel()
+{
+    uint64_t count;
+    if (read(cancel_fd_, &count, sizeof(count)) < 0) {
+        if (errno != EAGAIN) {
+            throw std::runtime_error("eventfd read failed with errno: " + std::to_string(errno));
+        }
+        return false;
+    }
+    return true;
+}
+
+DeadlineTrigger::Result DeadlineTrigger::wait_and_fire(int64_t deadline_us, const std::function<void()>& fire)
+{
+    const int64_t deadline_ns = deadline_us * 1000;
+    const int64_t wake_ns = deadline_ns - spin_margin_us_ * 1000;
+
+    if (consume_cancel()) {
+        return CANCELLED;
+    }
+    if (now_ns() >= deadline_ns) {
+        return MISSED;
+    }
+
+    // Coarse wait on the timer, unless we are already within the margin.
+    if (now_ns() < wake_ns) {
+        struct itimerspec spec = {};
+        spec.it_value.tv_sec = wake_ns / 1000000000;
+        spec.it_value.tv_nsec = wake_ns % 1000000000;
+        if (timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr) == -1) {
+            throw std::runtime_error("timerfd_settime failed with errno: " + std::to_string(errno));
+        }
+
+        struct pollfd pfds[2];
+        pfds[0].fd = timer_fd_;
+        pfds[0].events = POLLIN;
+        pfds[1].fd = cancel_fd_;
+        pfds[1].events = POLLIN;
+
+        int n_events;
+        do {
+            n_events = poll(pfds, 2, -1);
+        } while (n_events == -1 && errno == EINTR);
+
+        if (n_events == -1) {
+            throw std::runtime_error("poll failed with errno: " + std::to_string(errno));
+        }
+
+        if (pfds[1].revents & POLLIN) {
+            const struct itimerspec disarm = {};
+            timerfd_settime(timer_fd_, 0, &disarm, nullptr);
+            consume_cancel();
+            return CANCELLED;
+        }
+        uint64_t count;
+        if (read(timer_fd_, &count, sizeof(count)) < 0) {
+            throw std::runtime_error("timerfd read failed with errno: " + std::to_string(errno));
+        }
+    }
+
+    // Fine wait, spinning on the clock.
+    RealtimeScope realtime;
+    while (now_ns() < deadline_ns) {
+    }
+    fire();
+    last_latency_ns_ = now_ns() - deadline_ns;
+
+    return FIRED;
+}
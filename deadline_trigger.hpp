@@ -0,0 +1,73 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2022 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __DEADLINE_TRIGGER_HPP
+#define __DEADLINE_TRIGGER_HPP
+
+#include <cstdint>
+#include <functional>
+
+// Calls an action at an absolute time of day with low jitter.
+//
+// The calling thread sleeps on a CLOCK_REALTIME timerfd until spin_margin
+// before the deadline, and then busy-waits on the clock for the remainder.
+// While waiting, the thread is moved to SCHED_FIFO if the process is allowed
+// to, so that it is not preempted during the spin.
+class DeadlineTrigger
+{
+public:
+
+    enum Result
+    {
+        FIRED,
+        MISSED,
+        CANCELLED
+    };
+
+    DeadlineTrigger(int64_t spin_margin_us = 200);
+    ~DeadlineTrigger();
+
+    // Current time of day in microseconds since the epoch, same clock as
+    // the deadlines.
+    static int64_t now();
+
+    // Block until deadline_us and call fire. Returns CANCELLED without
+    // calling fire if a cancel() is pending or arrives before the deadline,
+    // and MISSED if the deadline has already passed.
+    Result wait_and_fire(int64_t deadline_us, const std::function<void()>& fire);
+
+    // Abort the wait in progress, or the next one if no thread is waiting
+    // yet. The cancellation stays pending until a wait consumes it or
+    // reset() is called. Safe to call from any thread.
+    void cancel();
+
+    // Discard a pending cancel(). Call before handing the wait to another
+    // thread, so that a cancel left from an earlier wait does not abort it
+    // while one issued after reset() still does.
+    void reset();
+
+    // Time from deadline until fire returned in the last FIRED wait, in
+    // nanoseconds. Includes the time spent in fire, e.g. sending a command.
+    int64_t last_latency_ns() const {return last_latency_ns_;}
+
+private:
+
+    // Read the cancel eventfd, returning true if a cancel() was pending.
+    bool consume_cancel();
+
+    const int64_t spin_margin_us_;
+
+    int timer_fd_;
+    int cancel_fd_;
+
+    int64_t last_latency_ns_;
+};
+
+#endif
@@ -10,13 +10,16 @@
 
 #include <boost/program_options/value_semantic.hpp>
 #include <iostream>
+#include <memory>
 #include <cstdlib>
 
 #include "wisdom_client.hpp"
+#include "wisdom_script.hpp"
 #include <i3ds/configurator.hpp>
 
 #include <boost/program_options.hpp>
 #include <vector>
+#include <fstream>
 
 #ifndef BOOST_LOG_DYN_LINK
 #define BOOST_LOG_DYN_LINK
@@ -36,6 +39,9 @@ int main(int argc, char *argv[])
     po::options_description desc("Allowed Wisdom GPR control options");
 
     std::vector<bool> tables;
+    int64_t trigger_time;
+    unsigned int trigger_delay;
+    std::string script_file;
 
     configurator.add_common_options(desc);
     desc.add_options()
@@ -43,16 +49,57 @@ int main(int argc, char *argv[])
     ("set-time,s", "Send SET_TIME command")
     ("load-tables,l", "Load parameter tables into Wisdom")
     ("set-tables", po::value<std::vector<bool>>(&tables)->multitoken(), "Set which tables to use. Ex 1 0 1 1")
+    ("arm-at", po::value<int64_t>(&trigger_time), "Start next measurement at time in microseconds since epoch, 0 to disarm")
+    ("arm-in", po::value<unsigned int>(&trigger_delay), "Start next measurement this many milliseconds from now")
+    ("script", po::value<std::string>(&script_file), "Run commands from script file over one connection, - for stdin")
     ;
 
     po::variables_map vm = configurator.parse_common_options(desc, argc, argv);
 
+    // Parse the script before connecting, so that syntax errors are found early.
+    std::unique_ptr<WisdomScript> script;
+    if (vm.count("script")) {
+        try {
+            if (script_file == "-") {
+                script.reset(new WisdomScript(std::cin));
+            }
+            else {
+                std::ifstream input(script_file);
+                if (!input) {
+                    BOOST_LOG_TRIVIAL(error) << "Cannot open script: " << script_file;
+                    return 1;
+                }
+                script.reset(new WisdomScript(input));
+            }
+        }
+        catch (const std::invalid_argument& e) {
+            BOOST_LOG_TRIVIAL(error) << "Error in script: " << e.what();
+            return 1;
+        }
+    }
+
     i3ds::Context::Ptr context(i3ds::Context::Create());
 
     BOOST_LOG_TRIVIAL(info) << "Connecting to Wisdom with node ID: " << configurator.node_id;
     WisdomClient wisdom(context, configurator.node_id);
     BOOST_LOG_TRIVIAL(trace) << "---> [OK]";
 
+    // Arm before --start is handled, so that the trigger applies to the
+    // measurement started by this invocation. Arming requires standby, so
+    // --activate is done here first instead of by the configurator.
+    if ((vm.count("arm-at") || vm.count("arm-in")) && vm.count("activate")) {
+      wisdom.Activate();
+      vm.erase("activate");
+    }
+
+    if (vm.count("arm-at")) {
+      wisdom.arm_trigger(trigger_time);
+    }
+
+    if (vm.count("arm-in")) {
+      wisdom.arm_trigger(DeadlineTrigger::now() + 1000 * static_cast<int64_t>(trigger_delay));
+    }
+
     configurator.handle_sensor_commands(vm, wisdom);
 
     if (vm.count("set-time")) {
@@ -71,5 +118,15 @@ int main(int argc, char *argv[])
       wisdom.table_select(tables);
     }
 
+    if (script) {
+      try {
+        script->run(wisdom, std::cout);
+      }
+      catch (const std::exception& e) {
+        BOOST_LOG_TRIVIAL(error) << "Script failed: " << e.what();
+        return 1;
+      }
+    }
+
   return 0;
 }
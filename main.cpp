@@ -44,6 +44,10 @@ int main(int argc, char *argv[])
     std::string port;
     std::string ip;
     std::string serial_dev;
+    std::string state_file;
+    std::string archive_file;
+    std::string quicklook_policy;
+    std::string archive_policy;
     i3ds::Configurator configurator;
 
     po::options_description desc("Allowed WISDOM options");
@@ -54,7 +58,11 @@ int main(int argc, char *argv[])
     ("dummy-delay,d", po::value<unsigned int>(&dummy_delay)->default_value(0), "Set to a value > 0 to run in dummy mode.")
     ("port,p", po::value<std::string>(&port)->default_value(""), "Port number of Wisdom server. Ignored if run in dummy mode")
     ("ip,i", po::value<std::string>(&ip)->default_value("127.0.0.1"), "IP address of WISDOM server")
-    ("serial_dev,s", po::value<std::string>(&serial_dev)->default_value(""), "Device file for serial port for power control");
+    ("serial_dev,s", po::value<std::string>(&serial_dev)->default_value(""), "Device file for serial port for power control")
+    ("state-file,t", po::value<std::string>(&state_file)->default_value(""), "File to persist instrument state across restarts")
+    ("archive,a", po::value<std::string>(&archive_file)->default_value(""), "File to append compressed traces to")
+    ("quicklook-policy", po::value<std::string>(&quicklook_policy)->default_value("drop-oldest"), "Quick-look backpressure: block, drop-oldest or quicklook-only")
+    ("archive-policy", po::value<std::string>(&archive_policy)->default_value("drop-oldest"), "Archive backpressure: block, drop-oldest or quicklook-only");
     po::variables_map vm = configurator.parse_common_options(desc, argc, argv);
 
     if (dummy_delay != 0) {
@@ -63,7 +71,8 @@ int main(int argc, char *argv[])
     BOOST_LOG_TRIVIAL(info) << "Node ID: " << node_id;
     i3ds::Context::Ptr context(i3ds::Context::Create());
     i3ds::Server server(context);
-    Wisdom wisdom(node_id, dummy_delay,serial_dev, port, ip);
+    Wisdom wisdom(context, node_id, dummy_delay,serial_dev, port, ip, state_file, archive_file,
+                  TraceSink::parse_policy(quicklook_policy), TraceSink::parse_policy(archive_policy));
 
     running = true;
     signal(SIGINT, signal_handler);
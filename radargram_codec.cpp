@@ -0,0 +1,401 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2022 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#include "radargram_codec.hpp"
+#include "wisdom_protocol.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+
+// Predictor selected per block, stored in PREDICTOR_BITS.
+enum Predictor : uint32_t
+{
+    PREDICT_INTRA = 0,  // Previous sample in same trace
+    PREDICT_INTER = 1,  // Same sample in previous trace
+    PREDICT_PLANAR = 2, // Previous sample plus vertical gradient
+    N_PREDICTORS = 3
+};
+
+const unsigned int PREDICTOR_BITS = 2;
+const unsigned int K_BITS = 4;
+const unsigned int MAX_K = 15;
+
+// Quotients at or above this are escaped and written as raw 16 bit values.
+const unsigned int Q_LIMIT = 16;
+
+inline uint16_t zigzag(uint16_t r)
+{
+    int16_t s = static_cast<int16_t>(r);
+    return static_cast<uint16_t>((static_cast<uint16_t>(s) << 1) ^ static_cast<uint16_t>(s >> 15));
+}
+
+inline uint16_t unzigzag(uint16_t z)
+{
+    return static_cast<uint16_t>((z >> 1) ^ static_cast<uint16_t>(-(z & 1)));
+}
+
+// All prediction arithmetic is done modulo 2^16 on unsigned values.
+inline uint16_t predict(uint32_t predictor, const uint16_t* cur, const uint16_t* prev, unsigned int s)
+{
+    switch (predictor) {
+        case PREDICT_INTER:
+            return prev[s];
+        case PREDICT_PLANAR:
+            return s == 0 ? prev[0] : static_cast<uint16_t>(cur[s - 1] + prev[s] - prev[s - 1]);
+        default:
+            return s == 0 ? 0 : cur[s - 1];
+    }
+}
+
+unsigned int select_k(uint32_t sum, unsigned int n)
+{
+    unsigned int k = 0;
+    while (k < MAX_K && (static_cast<uint64_t>(n) << (k + 1)) <= sum) {
+        k++;
+    }
+    return k;
+}
+
+class BitWriter
+{
+public:
+
+    BitWriter(std::vector<uint8_t>& out) : out_(out), acc_(0), n_bits_(0) {}
+
+    // Write the n lowest bits of value, n <= 32.
+    void put(uint32_t value, unsigned int n)
+    {
+        acc_ = (acc_ << n) | (value & ((static_cast<uint64_t>(1) << n) - 1));
+        n_bits_ += n;
+        while (n_bits_ >= 8) {
+            n_bits_ -= 8;
+            out_.push_back(static_cast<uint8_t>(acc_ >> n_bits_));
+        }
+    }
+
+    void flush()
+    {
+        if (n_bits_ > 0) {
+            out_.push_back(static_cast<uint8_t>(acc_ << (8 - n_bits_)));
+            n_bits_ = 0;
+        }
+    }
+
+private:
+
+    std::vector<uint8_t>& out_;
+    uint64_t acc_;
+    unsigned int n_bits_;
+};
+
+class BitReader
+{
+public:
+
+    BitReader(const uint8_t* data, size_t size) : data_(data), end_(data + size), acc_(0), n_bits_(0) {}
+
+    // Read n bits, n <= 32.
+    uint32_t get(unsigned int n)
+    {
+        if (n == 0) {
+            return 0;
+        }
+        refill();
+        if (n_bits_ < n) {
+            throw std::runtime_error("Radargram payload truncated");
+        }
+        n_bits_ -= n;
+        return static_cast<uint32_t>((acc_ >> n_bits_) & ((static_cast<uint64_t>(1) << n) - 1));
+    }
+
+    // True if all that is left unread is the zero padding of the last byte.
+    bool padding_is_zero() const
+    {
+        return data_ == end_ && n_bits_ < 8 && (acc_ & ((static_cast<uint64_t>(1) << n_bits_) - 1)) == 0;
+    }
+
+    // Count and consume leading zero bits, stopping at limit.
+    unsigned int zeros(unsigned int limit)
+    {
+        refill();
+        unsigned int n = 0;
+        while (n < limit) {
+            if (n_bits_ == 0) {
+                throw std::runtime_error("Radargram payload truncated");
+            }
+            if ((acc_ >> (n_bits_ - 1)) & 1) {
+                break;
+            }
+            n_bits_--;
+            n++;
+        }
+        return n;
+    }
+
+private:
+
+    void refill()
+    {
+        while (n_bits_ <= 56 && data_ < end_) {
+            acc_ = (acc_ << 8) | *data_++;
+            n_bits_ += 8;
+        }
+    }
+
+    const uint8_t* data_;
+    const uint8_t* end_;
+    uint64_t acc_;
+    unsigned int n_bits_;
+};
+
+void put_u16(std::vector<uint8_t>& out, uint16_t v)
+{
+    out.push_back(static_cast<uint8_t>(v));
+    out.push_back(static_cast<uint8_t>(v >> 8));
+}
+
+void put_u32(std::vector<uint8_t>& out, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) {
+        out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+    }
+}
+
+uint16_t get_u16(const uint8_t* p)
+{
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+uint32_t get_u32(const uint8_t* p)
+{
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8)
+           | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+} // namespace
+
+RadargramEncoder::RadargramEncoder(unsigned int samples_per_trace, unsigned int keyframe_interval) :
+    samples_per_trace_(samples_per_trace),
+    keyframe_interval_(std::max(1u, keyframe_interval)),
+    previous_(samples_per_trace),
+    has_previous_(false),
+    previous_table_(0),
+    trace_index_(0),
+    since_keyframe_(0)
+{
+    if (samples_per_trace == 0 || samples_per_trace > 0xFFFF) {
+        throw std::invalid_argument("Invalid number of samples per trace: " + std::to_string(samples_per_trace));
+    }
+}
+
+void RadargramEncoder::reset()
+{
+    has_previous_ = false;
+}
+
+size_t RadargramEncoder::encode_trace(const int16_t* samples, uint8_t table, std::vector<uint8_t>& out)
+{
+    return encode_trace(samples, table, trace_index_, out);
+}
+
+size_t RadargramEncoder::encode_trace(const int16_t* samples, uint8_t table, uint32_t trace_index,
+                                      std::vector<uint8_t>& out)
+{
+    const size_t start = out.size();
+    const bool keyframe = !has_previous_ || table != previous_table_ || trace_index != trace_index_
+        || since_keyframe_ >= keyframe_interval_;
+
+    out.push_back(radargram::MAGIC[0]);
+    out.push_back(radargram::MAGIC[1]);
+    out.push_back(keyframe ? radargram::FLAG_KEYFRAME : 0);
+    out.push_back(table);
+    put_u32(out, trace_index);
+    put_u16(out, static_cast<uint16_t>(samples_per_trace_));
+    const size_t payload_size_pos = out.size();
+    put_u32(out, 0);
+
+    const uint16_t* cur = reinterpret_cast<const uint16_t*>(samples);
+    const uint16_t* prev = reinterpret_cast<const uint16_t*>(previous_.data());
+    const uint32_t n_candidates = keyframe ? 1u : static_cast<uint32_t>(N_PREDICTORS);
+
+    uint16_t residuals[N_PREDICTORS][radargram::BLOCK_SIZE];
+    BitWriter writer(out);
+
+    for (unsigned int block = 0; block < samples_per_trace_; block += radargram::BLOCK_SIZE) {
+        const unsigned int n = std::min(radargram::BLOCK_SIZE, samples_per_trace_ - block);
+
+        uint32_t best = PREDICT_INTRA;
+        uint32_t best_sum = UINT32_MAX;
+        for (uint32_t p = 0; p < n_candidates; p++) {
+            uint32_t sum = 0;
+            for (unsigned int i = 0; i < n; i++) {
+                const unsigned int s = block + i;
+                const uint16_t z = zigzag(static_cast<uint16_t>(cur[s] - predict(p, cur, prev, s)));
+                residuals[p][i] = z;
+                sum += z;
+            }
+            if (sum < best_sum) {
+                best = p;
+                best_sum = sum;
+            }
+        }
+
+        const unsigned int k = select_k(best_sum, n);
+        writer.put(best, PREDICTOR_BITS);
+        writer.put(k, K_BITS);
+
+        for (unsigned int i = 0; i < n; i++) {
+            const uint32_t z = residuals[best][i];
+            const uint32_t q = z >> k;
+            if (q < Q_LIMIT) {
+                writer.put(1, q + 1);
+                writer.put(z, k);
+            }
+            else {
+                writer.put(0, Q_LIMIT);
+                writer.put(z, 16);
+            }
+        }
+    }
+    writer.flush();
+
+    const uint32_t payload_size = static_cast<uint32_t>(out.size() - payload_size_pos - 4);
+    for (int i = 0; i < 4; i++) {
+        out[payload_size_pos + i] = static_cast<uint8_t>(payload_size >> (8 * i));
+    }
+    put_u32(out, wisdom_protocol::crc32c(out.data() + start, out.size() - start));
+
+    std::copy(samples, samples + samples_per_trace_, previous_.begin());
+    has_previous_ = true;
+    previous_table_ = table;
+    since_keyframe_ = keyframe ? 1 : since_keyframe_ + 1;
+    trace_index_ = trace_index + 1;
+
+    return out.size() - start;
+}
+
+RadargramDecoder::RadargramDecoder(unsigned int samples_per_trace) :
+    samples_per_trace_(samples_per_trace),
+    previous_(samples_per_trace),
+    has_previous_(false),
+    previous_table_(0),
+    trace_index_(0),
+    skipped_(false)
+{
+    if (samples_per_trace == 0 || samples_per_trace > 0xFFFF) {
+        throw std::invalid_argument("Invalid number of samples per trace: " + std::to_string(samples_per_trace));
+    }
+}
+
+void RadargramDecoder::reset()
+{
+    has_previous_ = false;
+}
+
+size_t RadargramDecoder::resync(const uint8_t* data, size_t size)
+{
+    for (size_t i = 1; i + 1 < size; i++) {
+        if (data[i] == radargram::MAGIC[0] && data[i + 1] == radargram::MAGIC[1]) {
+            return i;
+        }
+    }
+    // Keep a trailing first magic byte, the rest may not have arrived yet.
+    return size > 1 && data[size - 1] == radargram::MAGIC[0] ? size - 1 : size;
+}
+
+size_t RadargramDecoder::decode_trace(const uint8_t* data, size_t size, std::vector<int16_t>& samples,
+                                      uint8_t& table)
+{
+    if (size < radargram::HEADER_SIZE) {
+        return 0;
+    }
+    skipped_ = false;
+    if (data[0] != radargram::MAGIC[0] || data[1] != radargram::MAGIC[1]) {
+        has_previous_ = false;
+        throw std::runtime_error("Radargram record has invalid magic");
+    }
+
+    const bool keyframe = data[2] & radargram::FLAG_KEYFRAME;
+    const uint8_t record_table = data[3];
+    const uint32_t index = get_u32(data + 4);
+    const uint16_t n_samples = get_u16(data + 8);
+    const uint32_t payload_size = get_u32(data + 10);
+
+    if (n_samples != samples_per_trace_) {
+        has_previous_ = false;
+        throw std::runtime_error("Radargram record has " + std::to_string(n_samples)
+                                 + " samples, expected " + std::to_string(samples_per_trace_));
+    }
+    if (size - radargram::HEADER_SIZE < static_cast<size_t>(payload_size) + radargram::CRC_SIZE) {
+        return 0;
+    }
+    if (wisdom_protocol::crc32c(data, radargram::HEADER_SIZE + payload_size)
+        != get_u32(data + radargram::HEADER_SIZE + payload_size)) {
+        has_previous_ = false;
+        throw std::runtime_error("Radargram record " + std::to_string(index) + " failed checksum");
+    }
+    if (!keyframe && (!has_previous_ || record_table != previous_table_ || index != trace_index_ + 1)) {
+        // The record is intact but cannot be decoded, consume it and wait
+        // for the next keyframe.
+        has_previous_ = false;
+        skipped_ = true;
+        trace_index_ = index;
+        table = record_table;
+        return radargram::HEADER_SIZE + payload_size + radargram::CRC_SIZE;
+    }
+
+    samples.resize(samples_per_trace_);
+    uint16_t* cur = reinterpret_cast<uint16_t*>(samples.data());
+    const uint16_t* prev = reinterpret_cast<const uint16_t*>(previous_.data());
+
+    BitReader reader(data + radargram::HEADER_SIZE, payload_size);
+
+    for (unsigned int block = 0; block < samples_per_trace_; block += radargram::BLOCK_SIZE) {
+        const unsigned int n = std::min(radargram::BLOCK_SIZE, samples_per_trace_ - block);
+        const uint32_t predictor = reader.get(PREDICTOR_BITS);
+        const unsigned int k = reader.get(K_BITS);
+
+        if (predictor >= N_PREDICTORS || (keyframe && predictor != PREDICT_INTRA)) {
+            has_previous_ = false;
+            throw std::runtime_error("Radargram record has invalid predictor");
+        }
+
+        for (unsigned int i = 0; i < n; i++) {
+            const unsigned int s = block + i;
+            const unsigned int q = reader.zeros(Q_LIMIT);
+            uint16_t z;
+            if (q < Q_LIMIT) {
+                reader.get(1);
+                z = static_cast<uint16_t>((q << k) | reader.get(k));
+            }
+            else {
+                z = static_cast<uint16_t>(reader.get(16));
+            }
+            cur[s] = static_cast<uint16_t>(predict(predictor, cur, prev, s) + unzigzag(z));
+        }
+    }
+
+    if (!reader.padding_is_zero()) {
+        has_previous_ = false;
+        throw std::runtime_error("Radargram record " + std::to_string(index) + " has trailing payload data");
+    }
+
+    std::copy(samples.begin(), samples.end(), previous_.begin());
+    has_previous_ = true;
+    previous_table_ = record_table;
+    trace_index_ = index;
+    table = record_table;
+
+    return radargram::HEADER_SIZE + payload_size + radargram::CRC_SIZE;
+}
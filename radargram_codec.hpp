@@ -0,0 +1,128 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2022 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __RADARGRAM_CODEC_HPP
+#define __RADARGRAM_CODEC_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Lossless compression of WISDOM radargram traces.
+//
+// Each trace is encoded as a self-contained record:
+//
+//   magic[2] flags[1] table[1] trace_index[4] sample_count[2] payload_size[4] payload crc32c[4]
+//
+// Multi-byte header fields are little endian. The CRC32C covers header and
+// payload, so that corruption is detected before it can propagate into the
+// traces predicted from the damaged one. The payload is split in blocks
+// of BLOCK_SIZE samples. For each block the encoder picks the best of three
+// predictors (previous sample, same sample in previous trace, or the planar
+// combination of both) and Rice codes the zig-zag mapped residuals.
+// Residuals are computed modulo 2^16, so every 16 bit input is reversible.
+//
+// A keyframe only uses intra-trace prediction and can be decoded on its own.
+// The encoder emits a keyframe on the first trace, when the table changes,
+// when the trace index does not follow the previous one and every
+// keyframe_interval traces, so that a lost record only affects the traces up
+// to the next keyframe.
+namespace radargram
+{
+
+static const uint8_t MAGIC[2] = {'W', 'R'};
+static const size_t HEADER_SIZE = 14;
+static const size_t CRC_SIZE = 4;
+static const unsigned int BLOCK_SIZE = 64;
+
+static const uint8_t FLAG_KEYFRAME = 0x01;
+
+} // namespace radargram
+
+class RadargramEncoder
+{
+public:
+
+    // Traces are expected to hold exactly samples_per_trace 16 bit samples.
+    RadargramEncoder(unsigned int samples_per_trace, unsigned int keyframe_interval = 64);
+
+    // Compress one trace and append the record to out. Returns the number
+    // of bytes appended. Traces are numbered consecutively.
+    size_t encode_trace(const int16_t* samples, uint8_t table, std::vector<uint8_t>& out);
+
+    // As above, recording the caller's trace index, e.g. the index within
+    // the acquisition. A keyframe is written if the index does not follow
+    // the previous one, so traces lost before encoding show as a gap.
+    size_t encode_trace(const int16_t* samples, uint8_t table, uint32_t trace_index,
+                        std::vector<uint8_t>& out);
+
+    // Force the next trace to be encoded as a keyframe, e.g. when a new
+    // archive file or downlink session is started.
+    void reset();
+
+    unsigned int samples_per_trace() const {return samples_per_trace_;}
+
+private:
+
+    const unsigned int samples_per_trace_;
+    const unsigned int keyframe_interval_;
+
+    std::vector<int16_t> previous_;
+    bool has_previous_;
+    uint8_t previous_table_;
+
+    // Index expected for the next trace.
+    uint32_t trace_index_;
+    unsigned int since_keyframe_;
+};
+
+class RadargramDecoder
+{
+public:
+
+    RadargramDecoder(unsigned int samples_per_trace);
+
+    // Decode one record from the start of data. Returns the number of bytes
+    // consumed, or 0 if data does not yet hold a complete record.
+    //
+    // A record that references a trace that was not decoded is consumed
+    // without touching samples, and skipped() returns true. Throws
+    // std::runtime_error if the record fails the checksum or is malformed;
+    // its size cannot be trusted then, so continue at the offset given by
+    // resync(). In both cases the next decoded trace is the next keyframe.
+    size_t decode_trace(const uint8_t* data, size_t size, std::vector<int16_t>& samples,
+                        uint8_t& table);
+
+    // True if the last record consumed by decode_trace() was skipped.
+    bool skipped() const {return skipped_;}
+
+    // Index of the last consumed trace.
+    uint32_t trace_index() const {return trace_index_;}
+
+    // Offset of the next possible record start after a rejected record at
+    // the start of data, found by scanning for MAGIC. Returns size if there
+    // is none yet.
+    static size_t resync(const uint8_t* data, size_t size);
+
+    // Forget the reference trace, the next record must be a keyframe.
+    void reset();
+
+private:
+
+    const unsigned int samples_per_trace_;
+
+    std::vector<int16_t> previous_;
+    bool has_previous_;
+    uint8_t previous_table_;
+    uint32_t trace_index_;
+    bool skipped_;
+};
+
+#endif
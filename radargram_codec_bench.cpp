@@ -0,0 +1,357 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2022 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+// Round trip tests and throughput benchmarks for the radargram codec.
+// Returns non-zero if any of the checks fail.
+
+#include "radargram_codec.hpp"
+#include "wisdom_protocol.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+
+const unsigned int SAMPLES = 1024;
+
+int failures = 0;
+
+void check(bool ok, const char* what)
+{
+    if (!ok) {
+        std::printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// Synthetic radargram: a few slowly moving reflectors with decaying ringing
+// on top of receiver noise, similar in structure to real WISDOM traces.
+std::vector<int16_t> make_radargram(unsigned int n_traces, double noise, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::normal_distribution<double> gauss(0.0, noise);
+    std::vector<int16_t> data(static_cast<size_t>(n_traces) * SAMPLES);
+
+    for (unsigned int t = 0; t < n_traces; t++) {
+        for (unsigned int s = 0; s < SAMPLES; s++) {
+            double v = gauss(rng);
+            for (int r = 0; r < 3; r++) {
+                const double depth = 100 + 250 * r + 20 * std::sin(0.01 * t + r);
+                const double d = s - depth;
+                if (d >= 0) {
+                    v += 8000.0 / (r + 1) * std::exp(-d / 40) * std::sin(0.3 * d);
+                }
+            }
+            data[static_cast<size_t>(t) * SAMPLES + s] = static_cast<int16_t>(std::lround(v));
+        }
+    }
+    return data;
+}
+
+std::vector<uint8_t> encode_all(const std::vector<int16_t>& data, uint8_t table, unsigned int keyframe_interval = 64)
+{
+    RadargramEncoder encoder(SAMPLES, keyframe_interval);
+    std::vector<uint8_t> out;
+    for (size_t t = 0; t < data.size() / SAMPLES; t++) {
+        encoder.encode_trace(data.data() + t * SAMPLES, table, out);
+    }
+    return out;
+}
+
+// Decodes the whole stream, returns false if it did not reproduce data.
+bool decode_all(const std::vector<uint8_t>& stream, const std::vector<int16_t>& data, uint8_t table)
+{
+    RadargramDecoder decoder(SAMPLES);
+    std::vector<int16_t> samples;
+    uint8_t record_table = 0;
+    size_t pos = 0;
+    size_t t = 0;
+
+    while (pos < stream.size()) {
+        const size_t n = decoder.decode_trace(stream.data() + pos, stream.size() - pos, samples, record_table);
+        if (n == 0 || record_table != table
+            || !std::equal(samples.begin(), samples.end(), data.begin() + t * SAMPLES)) {
+            return false;
+        }
+        pos += n;
+        t++;
+    }
+    return t == data.size() / SAMPLES;
+}
+
+void test_round_trip()
+{
+    const std::vector<int16_t> radargram = make_radargram(200, 20, 1);
+    const std::vector<uint8_t> stream = encode_all(radargram, 2);
+    check(decode_all(stream, radargram, 2), "Round trip of synthetic radargram");
+    check(stream.size() < radargram.size() * sizeof(int16_t) / 2, "Synthetic radargram compresses 2:1");
+
+    // White noise over the full range exercises the escape codes.
+    std::mt19937 rng(2);
+    std::vector<int16_t> noise(16 * SAMPLES);
+    for (int16_t& s : noise) {
+        s = static_cast<int16_t>(rng());
+    }
+    check(decode_all(encode_all(noise, 1), noise, 1), "Round trip of white noise");
+
+    // Alternating extremes wrap every residual.
+    std::vector<int16_t> extremes(4 * SAMPLES);
+    for (size_t i = 0; i < extremes.size(); i++) {
+        extremes[i] = (i + i / SAMPLES) % 2 ? std::numeric_limits<int16_t>::min() : std::numeric_limits<int16_t>::max();
+    }
+    check(decode_all(encode_all(extremes, 3), extremes, 3), "Round trip of alternating extremes");
+
+    // Every trace a keyframe.
+    check(decode_all(encode_all(radargram, 2, 1), radargram, 2), "Round trip with keyframe interval 1");
+
+    // Caller supplied indices with gaps are recorded and decode on their own.
+    {
+        const uint32_t indices[] = {0, 1, 2, 5, 6, 9, 10, 11};
+        RadargramEncoder encoder(SAMPLES);
+        std::vector<uint8_t> gapped;
+        for (uint32_t index : indices) {
+            encoder.encode_trace(radargram.data() + index * SAMPLES, 2, index, gapped);
+        }
+        RadargramDecoder decoder(SAMPLES);
+        std::vector<int16_t> samples;
+        uint8_t table = 0;
+        size_t pos = 0;
+        bool ok = true;
+        for (uint32_t index : indices) {
+            const size_t n = decoder.decode_trace(gapped.data() + pos, gapped.size() - pos, samples, table);
+            ok = ok && n > 0 && decoder.trace_index() == index
+                && std::equal(samples.begin(), samples.end(), radargram.begin() + index * SAMPLES);
+            pos += n;
+        }
+        check(ok && pos == gapped.size(), "Round trip with trace index gaps");
+    }
+
+    // A partial record is not consumed.
+    RadargramDecoder decoder(SAMPLES);
+    std::vector<int16_t> samples;
+    uint8_t table = 0;
+    RadargramEncoder encoder(SAMPLES);
+    std::vector<uint8_t> record;
+    encoder.encode_trace(radargram.data(), 2, record);
+    bool partial = true;
+    for (size_t size = 0; size < record.size(); size += 7) {
+        partial = partial && decoder.decode_trace(record.data(), size, samples, table) == 0;
+    }
+    check(partial, "Partial record returns 0");
+    check(decoder.decode_trace(record.data(), record.size(), samples, table) == record.size(),
+          "Complete record consumed");
+}
+
+// True if the record is not decoded, either because it is rejected or
+// because a corrupt size makes it look incomplete.
+bool decode_rejects(const std::vector<uint8_t>& record)
+{
+    RadargramDecoder decoder(SAMPLES);
+    std::vector<int16_t> samples;
+    uint8_t table = 0;
+    try {
+        return decoder.decode_trace(record.data(), record.size(), samples, table) == 0;
+    }
+    catch (const std::runtime_error&) {
+        return true;
+    }
+}
+
+// Rewrite the trailing checksum after tampering with a record.
+void fix_crc(std::vector<uint8_t>& record)
+{
+    const size_t n = record.size() - radargram::CRC_SIZE;
+    const uint32_t crc = wisdom_protocol::crc32c(record.data(), n);
+    for (size_t i = 0; i < radargram::CRC_SIZE; i++) {
+        record[n + i] = static_cast<uint8_t>(crc >> (8 * i));
+    }
+}
+
+void test_corruption(size_t trials)
+{
+    const std::vector<int16_t> radargram = make_radargram(1, 20, 3);
+    RadargramEncoder encoder(SAMPLES);
+    std::vector<uint8_t> record;
+    encoder.encode_trace(radargram.data(), 0, record);
+
+    // Up to three flipped bits anywhere in the record must be detected.
+    std::mt19937 rng(4);
+    size_t undetected = 0;
+    for (size_t i = 0; i < trials; i++) {
+        std::vector<uint8_t> corrupt = record;
+        const int n_flips = 1 + i % 3;
+        for (int f = 0; f < n_flips; f++) {
+            const size_t bit = rng() % (8 * corrupt.size());
+            corrupt[bit / 8] ^= static_cast<uint8_t>(1 << (bit % 8));
+        }
+        if (corrupt != record && !decode_rejects(corrupt)) {
+            undetected++;
+        }
+    }
+    check(undetected == 0, "Bit flips are detected");
+
+    // Extra payload bytes behind a valid encoding are rejected, even with
+    // a matching checksum.
+    std::vector<uint8_t> padded = record;
+    padded.insert(padded.end() - radargram::CRC_SIZE, 0);
+    const uint32_t payload_size = static_cast<uint32_t>(padded.size() - radargram::HEADER_SIZE - radargram::CRC_SIZE);
+    for (int i = 0; i < 4; i++) {
+        padded[10 + i] = static_cast<uint8_t>(payload_size >> (8 * i));
+    }
+    fix_crc(padded);
+    check(decode_rejects(padded), "Trailing payload byte rejected");
+}
+
+// Drop one record and corrupt another in a multi-record stream. Decoding
+// must skip to the next keyframe after each and reproduce all other traces.
+void test_recovery()
+{
+    const unsigned int n_traces = 200;
+    const unsigned int dropped = 10;
+    const unsigned int corrupted = 100;
+    const std::vector<int16_t> radargram = make_radargram(n_traces, 20, 6);
+
+    RadargramEncoder encoder(SAMPLES);
+    std::vector<uint8_t> stream;
+    for (unsigned int t = 0; t < n_traces; t++) {
+        std::vector<uint8_t> record;
+        encoder.encode_trace(radargram.data() + t * SAMPLES, 1, record);
+        if (t == corrupted) {
+            record[record.size() / 2] ^= 0x10;
+        }
+        if (t != dropped) {
+            stream.insert(stream.end(), record.begin(), record.end());
+        }
+    }
+
+    // With the default keyframe interval, traces 64 and 128 are keyframes.
+    RadargramDecoder decoder(SAMPLES);
+    std::vector<int16_t> samples;
+    uint8_t table = 0;
+    std::vector<bool> decoded(n_traces, false);
+    unsigned int rejected = 0;
+    unsigned int skipped = 0;
+    bool ok = true;
+    size_t pos = 0;
+    while (pos < stream.size()) {
+        try {
+            const size_t n = decoder.decode_trace(stream.data() + pos, stream.size() - pos, samples, table);
+            if (n == 0) {
+                ok = false;
+                break;
+            }
+            pos += n;
+            if (decoder.skipped()) {
+                skipped++;
+            }
+            else {
+                const uint32_t t = decoder.trace_index();
+                ok = ok && t < n_traces
+                    && std::equal(samples.begin(), samples.end(), radargram.begin() + t * SAMPLES);
+                decoded[t] = true;
+            }
+        }
+        catch (const std::runtime_error&) {
+            rejected++;
+            pos += RadargramDecoder::resync(stream.data() + pos, stream.size() - pos);
+        }
+    }
+
+    bool expected = true;
+    for (unsigned int t = 0; t < n_traces; t++) {
+        const bool lost = (t >= dropped && t < 64) || (t >= corrupted && t < 128);
+        expected = expected && decoded[t] == !lost;
+    }
+    check(ok, "Traces decoded after recovery are exact");
+    check(rejected > 0, "Corrupt record rejected");
+    check(skipped == (64 - dropped - 1) + (128 - corrupted - 1), "Orphaned records skipped");
+    check(expected, "Decoding resumes at the next keyframe");
+}
+
+template <typename F>
+void bench(const char* name, size_t iterations, size_t bytes_per_iteration, F f)
+{
+    for (size_t i = 0; i < iterations / 10 + 1; i++) {
+        f(i);
+    }
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        f(i);
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::printf("%-32s %10.1f us/trace %10.1f MB/s\n", name, 1e6 * seconds / iterations,
+                1e-6 * bytes_per_iteration * iterations / seconds);
+}
+
+void run_benchmarks(size_t n_traces)
+{
+    const unsigned int n_distinct = 256;
+    const std::vector<int16_t> radargram = make_radargram(n_distinct, 20, 5);
+    const size_t trace_bytes = SAMPLES * sizeof(int16_t);
+
+    RadargramEncoder encoder(SAMPLES);
+    std::vector<uint8_t> stream;
+    bench("encode_trace", n_traces, trace_bytes, [&](size_t i) {
+        if (i % n_distinct == 0) {
+            stream.clear();
+        }
+        encoder.encode_trace(radargram.data() + (i % n_distinct) * SAMPLES, 1, stream);
+    });
+
+    encoder.reset();
+    stream.clear();
+    std::vector<size_t> offsets;
+    for (unsigned int t = 0; t < n_distinct; t++) {
+        offsets.push_back(stream.size());
+        encoder.encode_trace(radargram.data() + t * SAMPLES, 1, stream);
+    }
+    offsets.push_back(stream.size());
+    std::printf("%-32s %10.2f\n", "compression ratio", static_cast<double>(n_distinct * trace_bytes) / stream.size());
+
+    RadargramDecoder decoder(SAMPLES);
+    std::vector<int16_t> samples;
+    uint8_t table = 0;
+    bench("decode_trace", n_traces, trace_bytes, [&](size_t i) {
+        const size_t t = i % n_distinct;
+        if (t == 0) {
+            decoder.reset();
+        }
+        decoder.decode_trace(stream.data() + offsets[t], offsets[t + 1] - offsets[t], samples, table);
+    });
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const size_t n_traces = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+
+    test_round_trip();
+    test_corruption(n_traces);
+    test_recovery();
+
+    if (failures > 0) {
+        std::printf("%d checks failed\n", failures);
+        return 1;
+    }
+    std::printf("All checks passed\n");
+
+    run_benchmarks(n_traces);
+    return 0;
+}
@@ -0,0 +1,124 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2022 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#include "radargram_quicklook.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+QuickLookPyramid::QuickLookPyramid(unsigned int samples_per_trace, unsigned int n_levels) :
+    samples_per_trace_(samples_per_trace),
+    levels_(n_levels),
+    sums_(n_levels),
+    pending_(n_levels, 0),
+    next_index_(0),
+    zeros_(samples_per_trace, 0)
+{
+    if (samples_per_trace == 0 || n_levels == 0) {
+        throw std::invalid_argument("Quick-look pyramid needs samples and at least one level");
+    }
+
+    unsigned int parent_samples = samples_per_trace;
+    for (unsigned int i = 0; i < n_levels; i++) {
+        levels_[i].factor = 2u << i;
+        levels_[i].samples_per_trace = (parent_samples + 1) / 2;
+        levels_[i].n_traces = 0;
+        sums_[i].assign(parent_samples, 0);
+        parent_samples = levels_[i].samples_per_trace;
+    }
+}
+
+void QuickLookPyramid::reset()
+{
+    for (unsigned int i = 0; i < levels_.size(); i++) {
+        levels_[i].n_traces = 0;
+        levels_[i].data.clear();
+        std::fill(sums_[i].begin(), sums_[i].end(), 0);
+        pending_[i] = 0;
+    }
+    next_index_ = 0;
+}
+
+void QuickLookPyramid::add_trace(const int16_t* samples)
+{
+    cascade(0, samples);
+    next_index_++;
+}
+
+void QuickLookPyramid::add_trace(const int16_t* samples, uint32_t index)
+{
+    fill_gap(index);
+    add_trace(samples);
+}
+
+void QuickLookPyramid::finish(uint32_t n_traces)
+{
+    fill_gap(n_traces);
+    finish();
+}
+
+void QuickLookPyramid::finish()
+{
+    // Flushing a level may add a trace to the next, so go top down.
+    for (unsigned int i = 0; i < levels_.size(); i++) {
+        if (pending_[i] > 0) {
+            emit(i);
+        }
+    }
+}
+
+void QuickLookPyramid::cascade(unsigned int level, const int16_t* samples)
+{
+    std::vector<int32_t>& sums = sums_[level];
+    for (size_t s = 0; s < sums.size(); s++) {
+        sums[s] += samples[s];
+    }
+    if (++pending_[level] == 2) {
+        emit(level);
+    }
+}
+
+void QuickLookPyramid::emit(unsigned int level)
+{
+    Level& l = levels_[level];
+    std::vector<int32_t>& sums = sums_[level];
+    const size_t first = l.data.size();
+    const int32_t n = pending_[level];
+
+    l.data.resize(first + l.samples_per_trace);
+    int16_t* out = &l.data[first];
+
+    for (unsigned int j = 0; j < l.samples_per_trace; j++) {
+        const unsigned int s = 2 * j;
+        if (s + 1 < sums.size()) {
+            out[j] = static_cast<int16_t>((sums[s] + sums[s + 1]) / (2 * n));
+        }
+        else {
+            out[j] = static_cast<int16_t>(sums[s] / n);
+        }
+    }
+    l.n_traces++;
+
+    std::fill(sums.begin(), sums.end(), 0);
+    pending_[level] = 0;
+
+    if (level + 1 < levels_.size()) {
+        cascade(level + 1, out);
+    }
+}
+
+void QuickLookPyramid::fill_gap(uint32_t index)
+{
+    // An index at or before the expected one is taken as the next trace.
+    while (next_index_ < index) {
+        cascade(0, zeros_.data());
+        next_index_++;
+    }
+}
@@ -0,0 +1,86 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2022 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __RADARGRAM_QUICKLOOK_HPP
+#define __RADARGRAM_QUICKLOOK_HPP
+
+#include <cstdint>
+#include <vector>
+
+// Incrementally built pyramid of decimated radargrams.
+//
+// Level i is decimated by 2^(i+1) in both trace and sample direction, using
+// the mean of each 2x2 cell of the level above. Traces are cascaded through
+// the levels as they are added, so the pyramid for a table is complete as
+// soon as its last trace has been added and finish() has been called.
+class QuickLookPyramid
+{
+public:
+
+    struct Level
+    {
+        // Decimation factor relative to the full resolution radargram.
+        unsigned int factor;
+
+        unsigned int samples_per_trace;
+        unsigned int n_traces;
+
+        // Decimated traces stored one after another.
+        std::vector<int16_t> data;
+    };
+
+    QuickLookPyramid(unsigned int samples_per_trace, unsigned int n_levels = 3);
+
+    // Clear all levels to start a new radargram.
+    void reset();
+
+    // Add one full resolution trace.
+    void add_trace(const int16_t* samples);
+
+    // As above, for the trace with the given index within the radargram.
+    // Traces missing before it, e.g. dropped by a slow consumer, are filled
+    // in with zeros, so that the spacing of the traces is kept.
+    void add_trace(const int16_t* samples, uint32_t index);
+
+    // Flush partially accumulated traces, e.g. when a table is done.
+    void finish();
+
+    // As above, first filling in the traces missing at the end of a
+    // radargram of n_traces traces.
+    void finish(uint32_t n_traces);
+
+    unsigned int n_levels() const {return levels_.size();}
+    const Level& level(unsigned int i) const {return levels_.at(i);}
+
+private:
+
+    // Add a trace with samples_per_trace of level-1 to level.
+    void cascade(unsigned int level, const int16_t* samples);
+
+    // Emit the accumulated pair of traces at level.
+    void emit(unsigned int level);
+
+    // Add zero traces until next_index_ reaches index.
+    void fill_gap(uint32_t index);
+
+    const unsigned int samples_per_trace_;
+
+    std::vector<Level> levels_;
+
+    // Column sums of the traces accumulated, but not yet emitted, per level.
+    std::vector<std::vector<int32_t>> sums_;
+    std::vector<unsigned int> pending_;
+
+    // Index expected for the next full resolution trace.
+    uint32_t next_index_;
+    std::vector<int16_t> zeros_;
+};
+
+#endif
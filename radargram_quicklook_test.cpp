@@ -0,0 +1,163 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2022 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+// Checks of the quick-look pyramid on small known inputs. Returns non-zero
+// if any of the checks fail.
+
+#include "radargram_quicklook.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+
+int failures = 0;
+
+void check(bool ok, const char* what)
+{
+    if (!ok) {
+        std::printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+bool level_is(const QuickLookPyramid::Level& level, unsigned int factor, unsigned int samples,
+              unsigned int traces, const std::vector<int16_t>& data)
+{
+    return level.factor == factor && level.samples_per_trace == samples && level.n_traces == traces
+        && level.data == data;
+}
+
+// Three traces of five samples, so that both the last sample column and the
+// last trace are averaged alone.
+const int16_t ODD[3][5] = {
+    {0, 2, 4, 6, 8},
+    {10, 12, 14, 16, 18},
+    {20, 22, 24, 26, 28}
+};
+
+void test_odd_sizes()
+{
+    QuickLookPyramid pyramid(5, 2);
+    check(pyramid.n_levels() == 2, "Number of levels");
+
+    pyramid.add_trace(ODD[0]);
+    pyramid.add_trace(ODD[1]);
+    check(level_is(pyramid.level(0), 2, 3, 1, {6, 10, 13}), "Level 0 after one pair");
+    check(level_is(pyramid.level(1), 4, 2, 0, {}), "Level 1 waits for a pair");
+
+    pyramid.add_trace(ODD[2]);
+    check(pyramid.level(0).n_traces == 1, "Odd trace is held back");
+
+    // Flushing the odd trace at level 0 completes a pair at level 1.
+    pyramid.finish();
+    check(level_is(pyramid.level(0), 2, 3, 2, {6, 10, 13, 21, 25, 28}), "Level 0 after finish");
+    check(level_is(pyramid.level(1), 4, 2, 1, {15, 20}), "Level 1 after finish");
+
+    // Nothing left to flush.
+    pyramid.finish();
+    check(pyramid.level(0).n_traces == 2 && pyramid.level(1).n_traces == 1, "Second finish is a no-op");
+}
+
+void test_negative()
+{
+    // Means are truncated toward zero.
+    QuickLookPyramid pyramid(2, 1);
+    const int16_t a[2] = {-3, -4};
+    const int16_t b[2] = {-5, -6};
+    pyramid.add_trace(a);
+    pyramid.add_trace(b);
+    check(level_is(pyramid.level(0), 2, 1, 1, {-4}), "Negative mean");
+}
+
+void test_reset()
+{
+    QuickLookPyramid pyramid(5, 2);
+    pyramid.add_trace(ODD[2]);
+    pyramid.add_trace(ODD[2]);
+    pyramid.add_trace(ODD[2]);
+
+    // The pending trace must not leak into the next table.
+    pyramid.reset();
+    check(level_is(pyramid.level(0), 2, 3, 0, {}) && level_is(pyramid.level(1), 4, 2, 0, {}),
+          "Levels empty after reset");
+
+    pyramid.add_trace(ODD[0]);
+    pyramid.add_trace(ODD[1]);
+    pyramid.finish();
+    check(level_is(pyramid.level(0), 2, 3, 1, {6, 10, 13}), "Level 0 after reset");
+    check(level_is(pyramid.level(1), 4, 2, 1, {8, 13}), "Level 1 flushed alone after reset");
+}
+
+void test_gaps()
+{
+    QuickLookPyramid pyramid(2, 1);
+    const int16_t a[2] = {4, 6};
+    const int16_t b[2] = {8, 10};
+
+    // Traces 1 and 2 are missing and count as zeros.
+    pyramid.add_trace(a, 0);
+    pyramid.add_trace(b, 3);
+    check(level_is(pyramid.level(0), 2, 1, 2, {2, 4}), "Missing traces filled with zeros");
+
+    // So do the last two of six traces.
+    pyramid.finish(6);
+    check(level_is(pyramid.level(0), 2, 1, 3, {2, 4, 0}), "Missing traces at the end filled");
+
+    // A repeated index is taken as the next trace, and the count restarts
+    // after reset.
+    pyramid.reset();
+    pyramid.add_trace(a, 0);
+    pyramid.add_trace(b, 0);
+    pyramid.finish(2);
+    check(level_is(pyramid.level(0), 2, 1, 1, {7}), "Repeated index and reset");
+}
+
+void test_full_size()
+{
+    const unsigned int samples = 1024;
+    const unsigned int traces = 256;
+    QuickLookPyramid pyramid(samples);
+    std::vector<int16_t> trace(samples, 100);
+    for (unsigned int t = 0; t < traces; t++) {
+        pyramid.add_trace(trace.data());
+    }
+    pyramid.finish();
+
+    bool ok = pyramid.n_levels() == 3;
+    for (unsigned int i = 0; ok && i < pyramid.n_levels(); i++) {
+        const QuickLookPyramid::Level& level = pyramid.level(i);
+        ok = level.factor == (2u << i) && level.samples_per_trace == samples >> (i + 1)
+            && level.n_traces == traces >> (i + 1)
+            && level.data.size() == static_cast<size_t>(level.samples_per_trace) * level.n_traces
+            && std::all_of(level.data.begin(), level.data.end(), [](int16_t v){return v == 100;});
+    }
+    check(ok, "Level sizes and values of a constant radargram");
+}
+
+} // namespace
+
+int main()
+{
+    test_odd_sizes();
+    test_negative();
+    test_reset();
+    test_gaps();
+    test_full_size();
+
+    if (failures > 0) {
+        std::printf("%d checks failed\n", failures);
+        return 1;
+    }
+    std::printf("All checks passed\n");
+    return 0;
+}
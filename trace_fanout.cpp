@@ -0,0 +1,337 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2022 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#include "trace_fanout.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <stdexcept>
+
+#ifndef BOOST_LOG_DYN_LINK
+#define BOOST_LOG_DYN_LINK
+#endif
+
+#include <boost/log/trivial.hpp>
+
+namespace
+{
+
+size_t round_up_power_of_two(size_t n)
+{
+    size_t p = 1;
+    while (p < n) {
+        p <<= 1;
+    }
+    return p;
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+/// TraceQueue
+////////////////////////////////////////////////////////////////////////////////
+
+TraceQueue::TraceQueue(size_t capacity) :
+    mask_(round_up_power_of_two(std::max<size_t>(capacity, 2)) - 1),
+    cells_(new Cell[mask_ + 1]),
+    head_(0),
+    tail_(0)
+{
+    for (size_t i = 0; i <= mask_; i++) {
+        cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+bool TraceQueue::try_push(const TracePtr& trace)
+{
+    const size_t pos = tail_.load(std::memory_order_relaxed);
+    Cell& cell = cells_[pos & mask_];
+    if (cell.sequence.load(std::memory_order_acquire) != pos) {
+        return false;
+    }
+    cell.trace = trace;
+    cell.end_of_table = trace->end_of_table;
+    cell.sequence.store(pos + 1, std::memory_order_release);
+    tail_.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool TraceQueue::try_pop(TracePtr& trace)
+{
+    size_t pos = head_.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell& cell = cells_[pos & mask_];
+        const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        const ptrdiff_t diff = static_cast<ptrdiff_t>(sequence) - static_cast<ptrdiff_t>(pos + 1);
+        if (diff == 0) {
+            // The producer may be dropping the same cell, whoever wins the
+            // exchange owns it.
+            if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                trace = std::move(cell.trace);
+                cell.trace.reset();
+                cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (diff < 0) {
+            return false;
+        }
+        else {
+            pos = head_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool TraceQueue::try_drop_oldest()
+{
+    size_t pos = head_.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell& cell = cells_[pos & mask_];
+        const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        const ptrdiff_t diff = static_cast<ptrdiff_t>(sequence) - static_cast<ptrdiff_t>(pos + 1);
+        if (diff == 0) {
+            if (cell.end_of_table) {
+                return false;
+            }
+            // The consumer may be popping the same cell, whoever wins the
+            // exchange owns it.
+            if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                cell.trace.reset();
+                cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (diff < 0) {
+            return false;
+        }
+        else {
+            pos = head_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+size_t TraceQueue::size() const
+{
+    const size_t head = head_.load(std::memory_order_acquire);
+    const size_t tail = tail_.load(std::memory_order_acquire);
+    return tail >= head ? tail - head : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// TraceSink
+////////////////////////////////////////////////////////////////////////////////
+
+TraceSink::TraceSink(const std::string& name, Consumer consumer, Policy policy, size_t capacity) :
+    name_(name),
+    consumer_(consumer),
+    policy_(policy),
+    queue_(capacity),
+    has_markers_(false),
+    running_(true),
+    high_watermark_(0),
+    dropped_(0),
+    decimated_(0),
+    degraded_(false)
+{
+    worker_ = std::thread(&TraceSink::run, this);
+}
+
+TraceSink::~TraceSink()
+{
+    running_ = false;
+    ready_.notify_one();
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+TraceSink::Policy TraceSink::parse_policy(const std::string& policy)
+{
+    if (policy == "block") {
+        return POLICY_BLOCK;
+    }
+    if (policy == "drop-oldest") {
+        return POLICY_DROP_OLDEST;
+    }
+    if (policy == "quicklook-only") {
+        return POLICY_QUICKLOOK_ONLY;
+    }
+    throw std::invalid_argument("Unknown sink policy: " + policy);
+}
+
+void TraceSink::offer(const TracePtr& trace)
+{
+    if (policy_ == POLICY_BLOCK) {
+        push_blocking(trace);
+    }
+    else if (trace->end_of_table) {
+        // A consumer that misses an end of table marker never finishes the
+        // table, but waiting for a stalled consumer would stall acquisition.
+        {
+            std::lock_guard<std::mutex> lock(markers_mutex_);
+            markers_.push_back(trace);
+            has_markers_ = true;
+        }
+        flush_markers();
+    }
+    else if (has_markers_ && !flush_markers()) {
+        // A held back marker must reach the consumer first.
+        dropped_++;
+        return;
+    }
+    else if (policy_ == POLICY_DROP_OLDEST) {
+        while (!queue_.try_push(trace)) {
+            if (queue_.try_drop_oldest()) {
+                dropped_++;
+            }
+            else if (queue_.size() >= queue_.capacity()) {
+                // The oldest is a marker, drop the new trace instead.
+                dropped_++;
+                return;
+            }
+        }
+    }
+    else {
+        const size_t size = queue_.size();
+        if (!degraded_ && size >= 3 * queue_.capacity() / 4) {
+            BOOST_LOG_TRIVIAL(warning) << "Sink " << name_ << " is falling behind, passing quick-look traces only";
+            degraded_ = true;
+        }
+        else if (degraded_ && size <= queue_.capacity() / 4) {
+            BOOST_LOG_TRIVIAL(info) << "Sink " << name_ << " has caught up";
+            degraded_ = false;
+        }
+        if (degraded_ && trace->index % QUICKLOOK_FACTOR != 0) {
+            decimated_++;
+            return;
+        }
+        if (!queue_.try_push(trace)) {
+            dropped_++;
+            return;
+        }
+    }
+
+    const size_t size = queue_.size();
+    if (size > high_watermark_) {
+        high_watermark_ = size;
+    }
+    ready_.notify_one();
+}
+
+void TraceSink::push_blocking(const TracePtr& trace)
+{
+    while (!queue_.try_push(trace)) {
+        ready_.notify_one();
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+bool TraceSink::flush_markers()
+{
+    std::lock_guard<std::mutex> lock(markers_mutex_);
+    while (!markers_.empty()) {
+        if (!queue_.try_push(markers_.front())) {
+            // Make room by evicting a trace, unless the oldest is a marker.
+            if (queue_.try_drop_oldest()) {
+                dropped_++;
+                continue;
+            }
+            return false;
+        }
+        markers_.pop_front();
+    }
+    has_markers_ = false;
+    return true;
+}
+
+bool TraceSink::pop_next(TracePtr& trace)
+{
+    if (queue_.try_pop(trace)) {
+        return true;
+    }
+    if (!has_markers_) {
+        return false;
+    }
+
+    // Everything offered before the oldest held back marker has been
+    // consumed once the queue is empty, and nothing is pushed while the
+    // lock is held.
+    std::lock_guard<std::mutex> lock(markers_mutex_);
+    if (queue_.try_pop(trace)) {
+        return true;
+    }
+    if (markers_.empty()) {
+        return false;
+    }
+    trace = markers_.front();
+    markers_.pop_front();
+    has_markers_ = !markers_.empty();
+    return true;
+}
+
+void TraceSink::run()
+{
+    TracePtr trace;
+    for (;;) {
+        // Read the flag first, so that all traces offered before stopping
+        // are consumed.
+        const bool stopping = !running_;
+
+        while (pop_next(trace)) {
+            try {
+                consumer_(*trace);
+            }
+            catch (const std::exception& e) {
+                BOOST_LOG_TRIVIAL(error) << "Sink " << name_ << " failed: " << e.what();
+            }
+            trace.reset();
+        }
+
+        if (stopping) {
+            break;
+        }
+
+        // Wake-ups are not synchronized with the queue, the timeout bounds
+        // the latency of a missed notification.
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait_for(lock, std::chrono::milliseconds(10));
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// TraceFanout
+////////////////////////////////////////////////////////////////////////////////
+
+void TraceFanout::add_sink(const std::string& name, TraceSink::Consumer consumer,
+                           TraceSink::Policy policy, size_t capacity)
+{
+    sinks_.emplace_back(new TraceSink(name, consumer, policy, capacity));
+}
+
+void TraceFanout::publish(const TracePtr& trace)
+{
+    for (const std::unique_ptr<TraceSink>& sink : sinks_) {
+        sink->offer(trace);
+    }
+}
+
+void TraceFanout::log_statistics() const
+{
+    for (const std::unique_ptr<TraceSink>& sink : sinks_) {
+        BOOST_LOG_TRIVIAL(info) << "Sink " << sink->name() << ": high watermark " << sink->high_watermark()
+                                << ", dropped " << sink->dropped() << ", decimated " << sink->decimated();
+    }
+}
+
+void TraceFanout::stop()
+{
+    sinks_.clear();
+}
@@ -0,0 +1,206 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2022 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __TRACE_FANOUT_HPP
+#define __TRACE_FANOUT_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One acquired trace, shared read-only between all sinks.
+struct Trace
+{
+    uint32_t acquisition_id;
+    uint8_t table;
+
+    // Index of the trace within the table, or the number of traces in the
+    // table for an end of table marker.
+    uint32_t index;
+
+    // Marks the end of a table, samples is empty.
+    bool end_of_table;
+
+    std::vector<int16_t> samples;
+};
+
+typedef std::shared_ptr<const Trace> TracePtr;
+
+// Bounded lock-free queue with a single producer and a single consumer.
+//
+// Every slot carries a sequence number, so that the producer may also pop
+// the oldest element to make room for a new one. Capacity is rounded up to
+// a power of two.
+class TraceQueue
+{
+public:
+
+    TraceQueue(size_t capacity);
+
+    // Producer only. Returns false if the queue is full.
+    bool try_push(const TracePtr& trace);
+
+    // Consumer only.
+    bool try_pop(TracePtr& trace);
+
+    // Producer only. Discard the oldest element, unless it is an end of
+    // table marker. Returns false if nothing was discarded.
+    bool try_drop_oldest();
+
+    // Number of queued elements, exact only when called by the producer
+    // or the consumer while the other is idle.
+    size_t size() const;
+
+    size_t capacity() const {return mask_ + 1;}
+
+private:
+
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        TracePtr trace;
+
+        // Copy of trace->end_of_table, only accessed by the producer.
+        bool end_of_table;
+    };
+
+    const size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+
+    // Padded to separate cache lines, to avoid false sharing between the
+    // producer and consumer.
+    std::atomic<size_t> head_;
+    char padding_[64];
+    std::atomic<size_t> tail_;
+};
+
+// A consumer of traces running in its own thread, fed through a TraceQueue.
+class TraceSink
+{
+public:
+
+    // What offer() does when the queue is full. End of table markers are
+    // never dropped or decimated. Unless the policy is to block, a marker
+    // takes the place of the oldest queued trace, or is held back until
+    // there is room if the oldest is a marker too. Traces offered while a
+    // marker is held back are dropped, so that the order is kept.
+    enum Policy
+    {
+        // Wait for the consumer to make room.
+        POLICY_BLOCK,
+
+        // Discard the oldest queued trace, or the new one if the oldest is
+        // an end of table marker.
+        POLICY_DROP_OLDEST,
+
+        // Above 3/4 full, only pass every QUICKLOOK_FACTOR trace until the
+        // queue has drained to 1/4, then drop the newest if still full.
+        POLICY_QUICKLOOK_ONLY
+    };
+
+    // Decimation in degraded mode, same as the coarsest quick-look level.
+    static const unsigned int QUICKLOOK_FACTOR = 8;
+
+    typedef std::function<void(const Trace&)> Consumer;
+
+    TraceSink(const std::string& name, Consumer consumer, Policy policy, size_t capacity);
+
+    // Consume the remaining traces and stop the thread.
+    ~TraceSink();
+
+    // Called from the producer thread only.
+    void offer(const TracePtr& trace);
+
+    const std::string& name() const {return name_;}
+    Policy policy() const {return policy_;}
+
+    // Largest number of traces queued at once.
+    size_t high_watermark() const {return high_watermark_;}
+
+    // Traces lost because the queue was full.
+    uint64_t dropped() const {return dropped_;}
+
+    // Traces skipped while degraded to quick-look only.
+    uint64_t decimated() const {return decimated_;}
+
+    // Parse "block", "drop-oldest" or "quicklook-only".
+    static Policy parse_policy(const std::string& policy);
+
+private:
+
+    void push_blocking(const TracePtr& trace);
+
+    // Producer only. Move held back markers to the queue, returns true if
+    // none are left.
+    bool flush_markers();
+
+    // Consumer only. Next trace from the queue, or a held back marker once
+    // the queue is empty.
+    bool pop_next(TracePtr& trace);
+
+    void run();
+
+    const std::string name_;
+    const Consumer consumer_;
+    const Policy policy_;
+
+    TraceQueue queue_;
+
+    // End of table markers that did not fit in the queue, oldest first.
+    // Only set by the producer, so it may skip the lock when it is false.
+    std::mutex markers_mutex_;
+    std::deque<TracePtr> markers_;
+    std::atomic<bool> has_markers_;
+
+    std::atomic<bool> running_;
+    std::mutex mutex_;
+    std::condition_variable ready_;
+
+    // Producer side statistics.
+    std::atomic<size_t> high_watermark_;
+    std::atomic<uint64_t> dropped_;
+    std::atomic<uint64_t> decimated_;
+    bool degraded_;
+
+    std::thread worker_;
+};
+
+// Distributes acquired traces to a set of sinks without blocking on them,
+// unless a sink has POLICY_BLOCK.
+class TraceFanout
+{
+public:
+
+    // Add a sink. Must be done before the first publish().
+    void add_sink(const std::string& name, TraceSink::Consumer consumer,
+                  TraceSink::Policy policy, size_t capacity);
+
+    // Offer the trace to all sinks. Called from one producer thread.
+    void publish(const TracePtr& trace);
+
+    // Log high watermark and drop counters for all sinks.
+    void log_statistics() const;
+
+    // Drain all sinks and stop their threads.
+    void stop();
+
+private:
+
+    std::vector<std::unique_ptr<TraceSink>> sinks_;
+};
+
+#endif
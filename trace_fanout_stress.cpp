@@ -0,0 +1,192 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2022 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+// Stress test of the trace sinks with consumers that are slower than the
+// producer, or stalled altogether. Checks that no end of table marker is
+// lost, that traces arrive in order, that every trace is either consumed or
+// counted as dropped or decimated, and that a stalled consumer does not
+// stall the producer unless it blocks. Returns non-zero if any of the checks
+// fail.
+
+#include "trace_fanout.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+int failures = 0;
+
+void check(bool ok, const char* sink, const char* what)
+{
+    if (!ok) {
+        std::printf("FAIL: %s: %s\n", sink, what);
+        failures++;
+    }
+}
+
+// What one consumer saw, only touched from its sink thread until the sink
+// is destroyed.
+struct Received
+{
+    explicit Received(unsigned int slowdown, const std::atomic<bool>* stalled = nullptr) :
+        slowdown(slowdown), stalled(stalled), table(0), last_index(-1), traces(0), markers(0),
+        in_order(true) {}
+
+    void consume(const Trace& trace)
+    {
+        while (stalled != nullptr && *stalled) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (trace.table != table) {
+            in_order = false;
+        }
+        if (trace.end_of_table) {
+            markers++;
+            table++;
+            last_index = -1;
+            return;
+        }
+        if (static_cast<int64_t>(trace.index) <= last_index) {
+            in_order = false;
+        }
+        last_index = trace.index;
+        traces++;
+
+        if (slowdown > 0 && traces % slowdown == 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+
+    const unsigned int slowdown;
+    const std::atomic<bool>* stalled;
+    unsigned int table;
+    int64_t last_index;
+    uint64_t traces;
+    unsigned int markers;
+    bool in_order;
+};
+
+// Offer n_tables tables of n_traces traces, each followed by its end of
+// table marker, to all sinks. Returns the time taken in seconds.
+double publish(const std::vector<std::unique_ptr<TraceSink>>& sinks, unsigned int n_tables,
+               unsigned int n_traces)
+{
+    const auto start = std::chrono::steady_clock::now();
+    for (unsigned int table = 0; table < n_tables; table++) {
+        for (unsigned int index = 0; index <= n_traces; index++) {
+            std::shared_ptr<Trace> trace = std::make_shared<Trace>();
+            trace->acquisition_id = 1;
+            trace->table = static_cast<uint8_t>(table);
+            trace->index = index;
+            trace->end_of_table = index == n_traces;
+            if (!trace->end_of_table) {
+                trace->samples.assign(16, static_cast<int16_t>(index));
+            }
+            for (const std::unique_ptr<TraceSink>& sink : sinks) {
+                sink->offer(trace);
+            }
+        }
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Publish n_tables tables of n_traces traces to one sink per policy, then
+// check what every consumer received. With stall_s > 0, the consumers do
+// not return until publishing is done, which must take less than stall_s.
+void run(const std::vector<std::string>& policies, unsigned int n_tables, unsigned int n_traces,
+         double stall_s = 0)
+{
+    const size_t capacity = 64;
+    const size_t n_sinks = policies.size();
+    std::atomic<bool> stalled(stall_s > 0);
+
+    // Sinks are used directly rather than through TraceFanout, so that their
+    // counters can be read before they are drained and destroyed.
+    std::vector<std::unique_ptr<Received>> received;
+    std::vector<std::unique_ptr<TraceSink>> sinks;
+    for (const std::string& policy : policies) {
+        received.emplace_back(stall_s > 0 ? new Received(0, &stalled) : new Received(4));
+        Received* r = received.back().get();
+        sinks.emplace_back(new TraceSink(policy, [r](const Trace& t){r->consume(t);},
+                                         TraceSink::parse_policy(policy), capacity));
+    }
+
+    double seconds;
+    if (stall_s > 0) {
+        // A producer stuck behind a stalled consumer never returns, so give
+        // up on it rather than hang.
+        std::future<double> done = std::async(std::launch::async, [&](){return publish(sinks, n_tables, n_traces);});
+        if (done.wait_for(std::chrono::duration<double>(stall_s)) != std::future_status::ready) {
+            std::printf("FAIL: Producer stalled by consumers that never return\n");
+            std::fflush(stdout);
+            std::_Exit(1);
+        }
+        seconds = done.get();
+        stalled = false;
+    }
+    else {
+        seconds = publish(sinks, n_tables, n_traces);
+    }
+
+    std::vector<uint64_t> lost(n_sinks);
+    for (size_t i = 0; i < n_sinks; i++) {
+        lost[i] = sinks[i]->dropped() + sinks[i]->decimated();
+        sinks[i].reset();
+    }
+
+    const uint64_t published = static_cast<uint64_t>(n_tables) * n_traces;
+    std::printf("Published %u tables of %u traces in %.3f s\n", n_tables, n_traces, seconds);
+    for (size_t i = 0; i < n_sinks; i++) {
+        const char* name = policies[i].c_str();
+        const Received& r = *received[i];
+        std::printf("  %-16s %10llu traces %10llu lost %4u markers\n", name,
+                    static_cast<unsigned long long>(r.traces), static_cast<unsigned long long>(lost[i]),
+                    r.markers);
+        check(r.markers == n_tables, name, "All end of table markers delivered");
+        check(r.in_order, name, "Traces delivered in order");
+        check(r.traces + lost[i] == published, name, "Every trace consumed or counted as lost");
+        if (policies[i] == "block") {
+            check(lost[i] == 0, name, "Blocking sink loses nothing");
+        }
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const unsigned int n_tables = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20;
+    const unsigned int n_traces = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 2000;
+
+    // Without a blocking sink the producer runs flat out, and the slow
+    // consumers overflow continuously.
+    run({"drop-oldest", "quicklook-only"}, n_tables, n_traces);
+    run({"block", "drop-oldest", "quicklook-only"}, n_tables, n_traces);
+
+    // Consumers that never return while the producer runs. More tables than
+    // the queue holds, so that markers have to be held back.
+    run({"drop-oldest", "quicklook-only"}, 100, 200, 10.0);
+
+    if (failures > 0) {
+        std::printf("%d checks failed\n", failures);
+        return 1;
+    }
+    std::printf("All checks passed\n");
+    return 0;
+}
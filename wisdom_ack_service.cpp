@@ -4,6 +4,7 @@
 #include <string.h>
 #include <netdb.h>
 
+#include <chrono>
 #include <sstream>
 
 #ifndef BOOST_LOG_DYN_LINK
@@ -15,14 +16,14 @@ namespace po = boost::program_options;
 
 #include <i3ds/configurator.hpp>
 
-#define CMD_LEN 4
+#include "wisdom_protocol.hpp"
 
 int main(int argc, char **argv)
 {
     int sockfd;
     struct addrinfo hints, *servinfo;
     struct sockaddr_storage remote_addr;
-    char buf[CMD_LEN];
+    char buf[wisdom_protocol::COMMAND_SIZE];
 
     unsigned int delay;
     std::string port;
@@ -58,11 +59,14 @@ int main(int argc, char **argv)
 
     freeaddrinfo(servinfo);
 
+    const auto started = std::chrono::steady_clock::now();
+    bool tables_loaded = false;
+
     BOOST_LOG_TRIVIAL(info) << "WISDOM ACK service ready";
     int n_bytes;
     socklen_t addr_len = sizeof(remote_addr);
     while (strcmp(buf, "end")) {
-        if ((n_bytes = recvfrom(sockfd, buf, CMD_LEN , 0,
+        if ((n_bytes = recvfrom(sockfd, buf, wisdom_protocol::COMMAND_SIZE, 0,
                         (struct sockaddr *)&remote_addr, &addr_len)) == -1) {
             BOOST_LOG_TRIVIAL(error) << "recvfrom failed with errno: " << errno;
             exit(1);
@@ -74,8 +78,27 @@ int main(int argc, char **argv)
         }
         BOOST_LOG_TRIVIAL(info) << ss.str();
         sleep(delay);
-        BOOST_LOG_TRIVIAL(info) << "Sending ACK: " << (int)buf[0];
-        if ((sendto(sockfd, buf, 1, 0, (struct sockaddr *)&remote_addr, addr_len)) == -1) {
+
+        // HK_REQUEST is answered with a housekeeping packet, all other
+        // commands with an ACK.
+        uint8_t reply[wisdom_protocol::MAX_PACKET_SIZE];
+        size_t reply_size = 1;
+        reply[0] = static_cast<uint8_t>(buf[0]);
+        if (reply[0] == wisdom_protocol::SCI_CONFIG) {
+            tables_loaded = true;
+        }
+        if (reply[0] == wisdom_protocol::HK_REQUEST) {
+            wisdom_protocol::Housekeeping hk;
+            hk.uptime_s = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::steady_clock::now() - started).count());
+            hk.tables_loaded = tables_loaded;
+            reply_size = wisdom_protocol::encode_housekeeping(hk, reply, sizeof(reply));
+            BOOST_LOG_TRIVIAL(info) << "Sending HK: uptime " << hk.uptime_s << " s";
+        }
+        else {
+            BOOST_LOG_TRIVIAL(info) << "Sending ACK: " << (int)buf[0];
+        }
+        if ((sendto(sockfd, reply, reply_size, 0, (struct sockaddr *)&remote_addr, addr_len)) == -1) {
             BOOST_LOG_TRIVIAL(error) << "sendto failed with errno: " << errno;
             exit(1);
         }
@@ -42,4 +42,18 @@ void WisdomClient::table_select(const std::vector<bool>& tables)
     }
     d.request.nCount = tables.size();
     Call<Wisdom::TableSelectService>(d);
-}
\ No newline at end of file
+}
+
+void WisdomClient::arm_trigger(int64_t time)
+{
+    Wisdom::ArmTriggerService::Data d;
+    Wisdom::ArmTriggerService::Initialize(d);
+    d.request.nCount = 0;
+    if (time != 0) {
+        for (unsigned int i = 0; i < sizeof(time); i++) {
+            d.request.arr[i] = static_cast<uint8_t>(time >> (8 * i));
+        }
+        d.request.nCount = sizeof(time);
+    }
+    Call<Wisdom::ArmTriggerService>(d);
+}
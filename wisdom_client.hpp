@@ -31,6 +31,10 @@ public:
     void set_time();
     void load_tables();
     void table_select(const std::vector<bool>& tables);
+
+    // Start the next measurement at time (microseconds since the epoch),
+    // or disarm if time is 0.
+    void arm_trigger(int64_t time);
 };
 
 
@@ -16,6 +16,8 @@
 
 #include <thread>
 #include <chrono>
+#include <cmath>
+#include <vector>
 
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -25,13 +27,41 @@
 #include <fcntl.h>
 #include <termios.h>
 
-Wisdom::Wisdom(i3ds_asn1::NodeID node, unsigned int dummy_delay,  std::string uart_dev, std::string port, std::string ip) :
+Wisdom::Wisdom(i3ds::Context::Ptr context, i3ds_asn1::NodeID node, unsigned int dummy_delay,
+               std::string uart_dev, std::string port, std::string ip, std::string state_file,
+               std::string archive_file, TraceSink::Policy quicklook_policy,
+               TraceSink::Policy archive_policy) :
     Sensor(node),
     dummy_delay_(dummy_delay),
-    running_(true)
+    running_(true),
+    trigger_time_(0),
+    waiting_for_trigger_(false),
+    publisher_(context, node),
+    quicklook_(SAMPLES_PER_TRACE),
+    archive_encoder_(SAMPLES_PER_TRACE),
+    state_file_(state_file),
+    state_restored_(false)
 {
     set_device_name("WISDOM GPR");
 
+    fanout_.add_sink("quicklook", [this](const Trace& t){consume_quicklook(t);}, quicklook_policy, SINK_QUEUE_SIZE);
+    if (archive_file != "") {
+        archive_.open(archive_file, std::ios::binary | std::ios::app);
+        if (!archive_) {
+            throw std::runtime_error("Cannot open archive file: " + archive_file);
+        }
+        fanout_.add_sink("archive", [this](const Trace& t){consume_archive(t);}, archive_policy, SINK_QUEUE_SIZE);
+    }
+
+    if (state_file_.load(state_)) {
+        BOOST_LOG_TRIVIAL(info) << "Restored state from " << state_file << ", last acquisition "
+                                << state_.last_acquisition_id;
+        state_restored_ = true;
+    }
+    else if (state_file_.enabled()) {
+        BOOST_LOG_TRIVIAL(info) << "No valid state in " << state_file << ", starting cold";
+    }
+
     if (dummy_delay == 0) {
         int rv;
         struct addrinfo hints;
@@ -105,6 +135,14 @@ Wisdom::Wisdom(i3ds_asn1::NodeID node, unsigned int dummy_delay,  std::string ua
 
 Wisdom::~Wisdom()
 {
+    // The worker publishes to the sinks, so it must be done before they
+    // are stopped.
+    running_ = false;
+    trigger_.cancel();
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+    fanout_.stop();
     if (dummy_delay_ == 0) {
         freeaddrinfo(wisdom_addr_);
         close(udp_socket_);
@@ -126,42 +164,88 @@ void Wisdom::Attach(i3ds::Server& server)
     server.Attach<SetTimeService>(node(), [this](SetTimeService::Data d){handle_set_time(d);});
     server.Attach<LoadTablesService>(node(), [this](LoadTablesService::Data d){handle_load_tables(d);});
     server.Attach<TableSelectService>(node(), [this](TableSelectService::Data d){handle_table_select(d);});
+    server.Attach<ArmTriggerService>(node(), [this](ArmTriggerService::Data d){handle_arm_trigger(d);});
 }
 
 void Wisdom::Stop()
 {
     running_ = false;
+    trigger_.cancel();
 }
 
 void Wisdom::do_activate()
 {
     BOOST_LOG_TRIVIAL(info) << "Activating WISDOM";
+
+    // Only the first activation after a restart can reuse the saved state.
+    bool verified = false;
+    if (state_restored_) {
+        state_restored_ = false;
+        verified = verify_restored_state();
+    }
+
     if (serial_port_ > 0) {
-        BOOST_LOG_TRIVIAL(info) << "Powering on";
-        if (power_on()) {
-            BOOST_LOG_TRIVIAL(info) << "Successfully powered on";
+        if (verified && state_.powered) {
+            BOOST_LOG_TRIVIAL(info) << "Already powered on, skipping power on";
         }
         else {
-            BOOST_LOG_TRIVIAL(error) << "Unable to power on";
-             throw i3ds::CommandError(i3ds_asn1::ResultCode_error_other, 
-                                 "Power on failed");
+            BOOST_LOG_TRIVIAL(info) << "Powering on";
+            if (power_on()) {
+                BOOST_LOG_TRIVIAL(info) << "Successfully powered on";
+                state_.powered = true;
+                state_.tables_loaded = false;
+                state_.time_set_at = 0;
+                save_state();
+            }
+            else {
+                BOOST_LOG_TRIVIAL(error) << "Unable to power on";
+                 throw i3ds::CommandError(i3ds_asn1::ResultCode_error_other, 
+                                     "Power on failed");
+            }
         }
     }
     if (dummy_delay_ == 0) {
-        BOOST_LOG_TRIVIAL(info) << "Sending SET_TIME command";
-        set_time();
-        BOOST_LOG_TRIVIAL(info) << "Sending SCI_CONFIG command";
-        load_tables();
+        if (verified && state_.time_set_at != 0
+            && DeadlineTrigger::now() - state_.time_set_at < TIME_SYNC_MAX_AGE_US) {
+            BOOST_LOG_TRIVIAL(info) << "Time was set " << (DeadlineTrigger::now() - state_.time_set_at) / 1000000
+                                    << " s ago, skipping SET_TIME";
+        }
+        else {
+            BOOST_LOG_TRIVIAL(info) << "Sending SET_TIME command";
+            set_time();
+        }
+        if (verified && state_.tables_loaded) {
+            BOOST_LOG_TRIVIAL(info) << "Tables already loaded, skipping SCI_CONFIG";
+        }
+        else {
+            BOOST_LOG_TRIVIAL(info) << "Sending SCI_CONFIG command";
+            load_tables();
+        }
     }
 
 }
 
 void Wisdom::do_start()
 {
+    // Refuse here rather than in the worker, so that the client is told and
+    // the node stays in standby.
+    const int64_t trigger_time = trigger_time_;
+    if (trigger_time != 0 && trigger_time <= DeadlineTrigger::now()) {
+        trigger_time_ = 0;
+        throw i3ds::CommandError(i3ds_asn1::ResultCode_error_value, "Armed trigger time has already passed");
+    }
     if (worker_.joinable()) {
         worker_.join();
     }
-    BOOST_LOG_TRIVIAL(info) << "Start WISDOM measurement";
+    if (trigger_time != 0) {
+        // Forget a cancel left from an earlier wait, one from do_stop()
+        // after this point must still abort the new wait.
+        trigger_.reset();
+        waiting_for_trigger_ = true;
+    }
+    state_.last_acquisition_id++;
+    save_state();
+    BOOST_LOG_TRIVIAL(info) << "Start WISDOM measurement " << state_.last_acquisition_id;
     if (dummy_delay_ == 0) {
         worker_ = std::thread(&Wisdom::wait_for_measurement_to_finish, this);
     }
@@ -172,6 +256,14 @@ void Wisdom::do_start()
 
 void Wisdom::do_stop()
 {
+    // A measurement that waits for its trigger has not reached WISDOM yet
+    // and can be called off. The worker returns to standby when cancelled.
+    if (waiting_for_trigger_.exchange(false)) {
+        BOOST_LOG_TRIVIAL(info) << "Cancelling measurement waiting for trigger";
+        trigger_.cancel();
+        worker_.join();
+        return;
+    }
     BOOST_LOG_TRIVIAL(warning) << "WISDOM does not support stopping measurement in progress";
     throw i3ds::CommandError(i3ds_asn1::ResultCode_error_unsupported , "Wisdom cannot stop active measurement");
 }
@@ -183,6 +275,10 @@ void Wisdom::do_deactivate()
         BOOST_LOG_TRIVIAL(info) << "Powering off";
         if (power_off()) {
             BOOST_LOG_TRIVIAL(info) << "Successfully powered off";
+            state_.powered = false;
+            state_.tables_loaded = false;
+            state_.time_set_at = 0;
+            save_state();
         }
         else {
             BOOST_LOG_TRIVIAL(error) << "Unable to power off";
@@ -192,63 +288,126 @@ void Wisdom::do_deactivate()
     }
 }
 
-void Wisdom::make_sci_config_cmd(char* buf, unsigned char table_number)
-{
-    buf[0] = 1;
-    buf[1] = table_number;
-    buf[2] = 0;
-    buf[3] = 0;
-}
-
-void Wisdom::make_sci_start_cmd(char* buf, unsigned char table_number)
-{
-    buf[0] = 3;
-    buf[1] = table_number;
-    buf[2] = 0;
-    buf[3] = 3;
-}
-
-void Wisdom::send_udp_command(const char* command)
+void Wisdom::send_udp_command(const wisdom_protocol::CommandPacket& command)
 {
-    if ((sendto(udp_socket_, command, CMD_LEN, 0, wisdom_addr_->ai_addr, wisdom_addr_->ai_addrlen)) != CMD_LEN) {
+    if ((sendto(udp_socket_, command.data(), command.size(), 0, wisdom_addr_->ai_addr,
+                wisdom_addr_->ai_addrlen)) != static_cast<ssize_t>(command.size())) {
         throw std::runtime_error("sendto failed with errno: " + std::to_string(errno));
     }
 }
 
-void Wisdom::wait_for_ack(const char expected_byte)
+ssize_t Wisdom::receive_udp(uint8_t* buf, size_t size, int timeout_ms)
 {
-    BOOST_LOG_TRIVIAL(info) << "Waiting for ACK";
     struct sockaddr_storage tmp_addr;
     socklen_t tmp_addr_len = sizeof(tmp_addr);
     struct pollfd pfds[1];
     pfds[0].fd = udp_socket_;
     pfds[0].events = POLLIN;
-    char ack_buf;
     int n_events = 0;
-    while (n_events == 0 && running_) {
-        n_events = poll(pfds, 1, 1000);
+    int waited_ms = 0;
+    while (n_events == 0 && running_ && (timeout_ms < 0 || waited_ms < timeout_ms)) {
+        const int wait_ms = timeout_ms < 0 ? 1000 : std::min(1000, timeout_ms - waited_ms);
+        n_events = poll(pfds, 1, wait_ms);
+        waited_ms += wait_ms;
+    }
+    if (n_events <= 0 || !(pfds[0].revents & POLLIN)) {
+        return -1;
+    }
+    ssize_t n_bytes = recvfrom(udp_socket_, buf, size, 0, (struct sockaddr *)&tmp_addr, &tmp_addr_len);
+    if (n_bytes == -1) {
+        throw std::runtime_error("recvfrom failed with errno: " + std::to_string(errno));
     }
-    if (pfds[0].revents & POLLIN) {
-        // We have a message to receive
-        if ((recvfrom(udp_socket_, &ack_buf, 1 , 0, (struct sockaddr *)&tmp_addr, &tmp_addr_len)) == -1) {
-            throw std::runtime_error("recvfrom failed with errno: " + std::to_string(errno));
+    return n_bytes;
+}
+
+void Wisdom::drain_udp()
+{
+    uint8_t buf[wisdom_protocol::MAX_PACKET_SIZE];
+    while (recv(udp_socket_, buf, sizeof(buf), MSG_DONTWAIT) >= 0) {
+        BOOST_LOG_TRIVIAL(warning) << "Discarding unexpected datagram";
+    }
+}
+
+bool Wisdom::wait_for_ack(wisdom_protocol::CommandId expected, int timeout_ms)
+{
+    BOOST_LOG_TRIVIAL(info) << "Waiting for ACK";
+    uint8_t ack_buf[wisdom_protocol::MAX_PACKET_SIZE];
+    ssize_t n_bytes;
+    while ((n_bytes = receive_udp(ack_buf, sizeof(ack_buf), timeout_ms)) >= 0) {
+        // A late HK reply, valid or not, is not an ACK. Keep waiting.
+        if (wisdom_protocol::is_framed(ack_buf, n_bytes) || n_bytes != wisdom_protocol::ACK_SIZE) {
+            BOOST_LOG_TRIVIAL(warning) << "Ignoring " << n_bytes << " byte datagram while waiting for ACK";
+            continue;
         }
-        BOOST_LOG_TRIVIAL(info) << "ACK received: " << (int)ack_buf;
-        if (ack_buf != expected_byte) {
-            BOOST_LOG_TRIVIAL(warning) << "WARNING: incorrect ack byte received, expected " 
-                                       << (int)expected_byte;
+        BOOST_LOG_TRIVIAL(info) << "ACK received: " << (n_bytes > 0 ? (int)ack_buf[0] : -1);
+        wisdom_protocol::DecodeStatus status = wisdom_protocol::decode_ack(ack_buf, n_bytes, expected);
+        if (status != wisdom_protocol::DECODE_OK) {
+            BOOST_LOG_TRIVIAL(warning) << "WARNING: incorrect ack received (" << wisdom_protocol::to_string(status)
+                                       << "), expected " << (int)expected;
         }
+        return status == wisdom_protocol::DECODE_OK;
     }
+    return false;
+}
+
+bool Wisdom::wait_for_housekeeping(wisdom_protocol::Housekeeping& hk, bool& has_hk, int timeout_ms)
+{
+    uint8_t buf[wisdom_protocol::MAX_PACKET_SIZE];
+    ssize_t n_bytes;
+    has_hk = false;
+    while ((n_bytes = receive_udp(buf, sizeof(buf), timeout_ms)) >= 0) {
+        if (!wisdom_protocol::is_framed(buf, n_bytes)) {
+            if (wisdom_protocol::decode_ack(buf, n_bytes, wisdom_protocol::HkRequest::id) == wisdom_protocol::DECODE_OK) {
+                return true;
+            }
+            BOOST_LOG_TRIVIAL(warning) << "Ignoring " << n_bytes << " byte datagram while waiting for HK";
+            continue;
+        }
+        wisdom_protocol::PacketView packet;
+        wisdom_protocol::DecodeStatus status = wisdom_protocol::decode_packet(buf, n_bytes, packet);
+        if (status == wisdom_protocol::DECODE_OK) {
+            status = wisdom_protocol::decode_housekeeping(packet, hk);
+        }
+        if (status == wisdom_protocol::DECODE_OK) {
+            has_hk = true;
+            return true;
+        }
+        BOOST_LOG_TRIVIAL(warning) << "Ignoring packet while waiting for HK ("
+                                   << wisdom_protocol::to_string(status) << ")";
+    }
+    return false;
 }
 
 void Wisdom::dummy_wait_for_measurement_to_finish()
 {
+    const unsigned int n_traces = 256;
+    std::vector<int16_t> trace(SAMPLES_PER_TRACE);
+
+    bool first = true;
     for (int i = 0; i < N_TABLES; i++) {
         if (active_tables_[i]) {
+            if (first && !wait_for_trigger([](){})) {
+                break;
+            }
+            first = false;
             BOOST_LOG_TRIVIAL(info) << "Starting dummy measurement with table " << std::to_string(i);
             std::this_thread::sleep_for(std::chrono::seconds(dummy_delay_));
             BOOST_LOG_TRIVIAL(info) << "Measurement done, retrieving data";
             std::this_thread::sleep_for(std::chrono::seconds(dummy_delay_));
+
+            // Synthetic radargram with a flat layer and a point reflector.
+            for (unsigned int t = 0; t < n_traces; t++) {
+                const double x = static_cast<double>(t) - n_traces / 2.0;
+                const double apex = SAMPLES_PER_TRACE / 2.0;
+                const double hyperbola = std::sqrt(apex * apex + 4.0 * x * x);
+                for (unsigned int s = 0; s < SAMPLES_PER_TRACE; s++) {
+                    const double layer = std::exp(-std::pow((s - SAMPLES_PER_TRACE / 4.0) / 4.0, 2));
+                    const double point = std::exp(-std::pow((s - hyperbola) / 4.0, 2));
+                    trace[s] = static_cast<int16_t>(8000.0 * layer + 4000.0 * point);
+                }
+                ingest_trace(i, t, trace.data());
+            }
+            finish_table(i, n_traces);
             BOOST_LOG_TRIVIAL(info) << "Data retreived";
         }
     }
@@ -258,22 +417,163 @@ void Wisdom::dummy_wait_for_measurement_to_finish()
 
 void Wisdom::wait_for_measurement_to_finish()
 {
-    char cmd[CMD_LEN];
+    bool first = true;
     for (int i = 0; i < N_TABLES; i++) {
         if (active_tables_[i]) {
             BOOST_LOG_TRIVIAL(info) << "Starting measurement with table " << std::to_string(i);
-            make_sci_start_cmd(cmd, i);
-            send_udp_command(cmd);
-            wait_for_ack(cmd[0]);
+            const wisdom_protocol::CommandPacket start = wisdom_protocol::SciStart::Encode(i);
+            if (first) {
+                if (!wait_for_trigger([&](){send_udp_command(start);})) {
+                    break;
+                }
+                first = false;
+            }
+            else {
+                send_udp_command(start);
+            }
+            wait_for_ack(wisdom_protocol::SciStart::id);
             BOOST_LOG_TRIVIAL(info) << "Measurement done, retrieving data";
-            send_udp_command(SCI_REQUEST);
-            wait_for_ack(SCI_REQUEST[0]);
+            send_udp_command(wisdom_protocol::SciRequest::Encode());
+            wait_for_ack(wisdom_protocol::SciRequest::id);
             BOOST_LOG_TRIVIAL(info) << "Data retreived";
         }
     }
     set_state(i3ds_asn1::SensorState_standby);
 }
 
+bool Wisdom::wait_for_trigger(const std::function<void()>& fire)
+{
+    const int64_t deadline = trigger_time_.exchange(0);
+    if (deadline == 0) {
+        fire();
+        return true;
+    }
+
+    // Only start if do_stop() has not claimed the measurement meanwhile.
+    bool fired = false;
+    auto claim_and_fire = [this, &fire, &fired]() {
+        if (waiting_for_trigger_.exchange(false)) {
+            fire();
+            fired = true;
+        }
+    };
+
+    BOOST_LOG_TRIVIAL(info) << "Waiting for trigger at " << deadline;
+    switch (trigger_.wait_and_fire(deadline, claim_and_fire)) {
+        case DeadlineTrigger::FIRED:
+            if (!fired) {
+                break;
+            }
+            BOOST_LOG_TRIVIAL(info) << "Triggered with latency " << trigger_.last_latency_ns() << " ns";
+            return true;
+        case DeadlineTrigger::MISSED:
+            // do_start() refused deadlines that had passed, so this is only
+            // the time taken to start the worker. Start late rather than not
+            // at all, the client has already been told the measurement runs.
+            BOOST_LOG_TRIVIAL(warning) << "Trigger time " << deadline << " passed while starting, "
+                                       << DeadlineTrigger::now() - deadline << " us late";
+            claim_and_fire();
+            if (!fired) {
+                break;
+            }
+            return true;
+        default:
+            waiting_for_trigger_ = false;
+            break;
+    }
+    BOOST_LOG_TRIVIAL(warning) << "Trigger cancelled";
+    return false;
+}
+
+void Wisdom::ingest_trace(uint8_t table, uint32_t index, const int16_t* samples)
+{
+    std::shared_ptr<Trace> trace = std::make_shared<Trace>();
+    trace->acquisition_id = state_.last_acquisition_id;
+    trace->table = table;
+    trace->index = index;
+    trace->end_of_table = false;
+    trace->samples.assign(samples, samples + SAMPLES_PER_TRACE);
+    fanout_.publish(trace);
+}
+
+void Wisdom::finish_table(uint8_t table, uint32_t n_traces)
+{
+    std::shared_ptr<Trace> trace = std::make_shared<Trace>();
+    trace->acquisition_id = state_.last_acquisition_id;
+    trace->table = table;
+    trace->index = n_traces;
+    trace->end_of_table = true;
+    fanout_.publish(trace);
+    fanout_.log_statistics();
+}
+
+void Wisdom::consume_quicklook(const Trace& trace)
+{
+    // The index keeps traces dropped by the sink as gaps in the pyramid.
+    if (!trace.end_of_table) {
+        quicklook_.add_trace(trace.samples.data(), trace.index);
+        return;
+    }
+    quicklook_.finish(trace.index);
+    BOOST_LOG_TRIVIAL(info) << "Publishing quick-look for table " << (int)trace.table;
+    publish_quicklook();
+    quicklook_.reset();
+}
+
+void Wisdom::consume_archive(const Trace& trace)
+{
+    if (trace.end_of_table) {
+        archive_.flush();
+        return;
+    }
+    archive_buffer_.clear();
+    // Record the acquisition index, so that traces dropped by the sink show
+    // as gaps in the archive.
+    archive_encoder_.encode_trace(trace.samples.data(), trace.table, trace.index, archive_buffer_);
+    archive_.write(reinterpret_cast<const char*>(archive_buffer_.data()), archive_buffer_.size());
+    if (!archive_) {
+        throw std::runtime_error("Write to archive failed");
+    }
+}
+
+void Wisdom::publish_quicklook()
+{
+    const i3ds_asn1::Timepoint now = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    // Coarsest level first, so that a preview arrives as early as possible.
+    for (int i = quicklook_.n_levels() - 1; i >= 0; i--) {
+        const QuickLookPyramid::Level& level = quicklook_.level(i);
+        if (level.n_traces == 0) {
+            continue;
+        }
+
+        // Offset the signed samples to unsigned pixels, zero becomes 32768.
+        // The buffer must outlive Send, the frame only refers to it.
+        std::vector<uint16_t> pixels(level.data.size());
+        for (size_t j = 0; j < pixels.size(); j++) {
+            pixels[j] = static_cast<uint16_t>(level.data[j] + 32768);
+        }
+
+        QuickLookTopic::Data frame;
+        i3ds::FrameCodec::Initialize(frame);
+
+        frame.descriptor.attributes.timestamp = now;
+        frame.descriptor.attributes.validity = i3ds_asn1::SampleValidity_sample_valid;
+        frame.descriptor.frame_mode = i3ds_asn1::Frame_mode_t_mode_mono;
+        frame.descriptor.data_depth = 16;
+        frame.descriptor.pixel_size = sizeof(uint16_t);
+        frame.descriptor.region.offset_x = 0;
+        frame.descriptor.region.offset_y = 0;
+        frame.descriptor.region.size_x = level.samples_per_trace;
+        frame.descriptor.region.size_y = level.n_traces;
+        frame.append_image(reinterpret_cast<const i3ds_asn1::byte*>(pixels.data()),
+                           pixels.size() * sizeof(uint16_t));
+
+        publisher_.Send<QuickLookTopic>(frame);
+    }
+}
+
 void Wisdom::handle_set_time(SetTimeService::Data)
 {
     check_standby();
@@ -318,23 +618,116 @@ void Wisdom::handle_table_select(TableSelectService::Data d)
     BOOST_LOG_TRIVIAL(info) << "Setting tables: " + current_setting;
 }
 
+void Wisdom::handle_arm_trigger(ArmTriggerService::Data d)
+{
+    check_standby();
+    if (d.request.nCount == 0) {
+        BOOST_LOG_TRIVIAL(info) << "Trigger disarmed";
+        trigger_time_ = 0;
+        return;
+    }
+    if (d.request.nCount != sizeof(int64_t)) {
+        throw i3ds::CommandError(i3ds_asn1::ResultCode_error_value,
+                                 "Requires " + std::to_string(sizeof(int64_t)) + " byte message");
+    }
+
+    int64_t trigger_time = 0;
+    for (unsigned int i = 0; i < sizeof(int64_t); i++) {
+        trigger_time |= static_cast<int64_t>(static_cast<uint8_t>(d.request.arr[i])) << (8 * i);
+    }
+    if (trigger_time <= DeadlineTrigger::now()) {
+        throw i3ds::CommandError(i3ds_asn1::ResultCode_error_value, "Trigger time has already passed");
+    }
+
+    BOOST_LOG_TRIVIAL(info) << "Trigger armed for " << trigger_time;
+    trigger_time_ = trigger_time;
+}
+
 void Wisdom::set_time()
 {
     if (dummy_delay_ == 0) {
-        send_udp_command(SET_TIME);
-        wait_for_ack(SET_TIME[0]);
+        send_udp_command(wisdom_protocol::SetTime::Encode());
+        if (wait_for_ack(wisdom_protocol::SetTime::id)) {
+            state_.time_set_at = DeadlineTrigger::now();
+            save_state();
+        }
     }
 }
 
 void Wisdom::load_tables()
 {
     if (dummy_delay_ == 0) {
-        char cmd[CMD_LEN];
+        bool loaded = true;
         for (unsigned int table = 1; table <= 4; table++) {
-            make_sci_config_cmd(cmd, table);
-            send_udp_command(cmd);
-            wait_for_ack(cmd[0]);
+            send_udp_command(wisdom_protocol::SciConfig::Encode(table));
+            loaded = wait_for_ack(wisdom_protocol::SciConfig::id) && loaded;
         }
+        state_.tables_loaded = loaded;
+        save_state();
+    }
+}
+
+bool Wisdom::verify_restored_state()
+{
+    if (dummy_delay_ != 0) {
+        return false;
+    }
+
+    BOOST_LOG_TRIVIAL(info) << "Verifying restored state with HK_REQUEST";
+    drain_udp();
+    send_udp_command(wisdom_protocol::HkRequest::Encode());
+    wisdom_protocol::Housekeeping hk;
+    bool has_hk = false;
+    const bool answered = wait_for_housekeeping(hk, has_hk, HK_TIMEOUT_MS);
+
+    // Do not let a duplicate or late reply be taken for the ACK of the
+    // next command.
+    drain_udp();
+
+    if (!answered) {
+        BOOST_LOG_TRIVIAL(warning) << "WISDOM did not answer HK_REQUEST, discarding restored state";
+        state_.powered = false;
+        state_.tables_loaded = false;
+        state_.time_set_at = 0;
+        save_state();
+        return false;
+    }
+
+    if (!has_hk) {
+        // Nothing to compare with, only trust that WISDOM is powered.
+        BOOST_LOG_TRIVIAL(warning) << "WISDOM answered HK_REQUEST without housekeeping, "
+                                   << "discarding restored time and tables";
+        state_.tables_loaded = false;
+        state_.time_set_at = 0;
+        save_state();
+        return true;
+    }
+
+    BOOST_LOG_TRIVIAL(info) << "WISDOM up for " << hk.uptime_s << " s, tables "
+                            << (hk.tables_loaded ? "loaded" : "not loaded");
+
+    // WISDOM answers, so it is powered, but it may have been restarted
+    // since the saved state was recorded.
+    const int64_t uptime_us = static_cast<int64_t>(hk.uptime_s) * 1000000;
+    if (state_.time_set_at != 0 && DeadlineTrigger::now() - state_.time_set_at > uptime_us) {
+        BOOST_LOG_TRIVIAL(warning) << "WISDOM restarted after the time was set, discarding restored time";
+        state_.time_set_at = 0;
+    }
+    if (state_.tables_loaded && !hk.tables_loaded) {
+        BOOST_LOG_TRIVIAL(warning) << "WISDOM reports tables not loaded, discarding restored tables";
+        state_.tables_loaded = false;
+    }
+    save_state();
+    return true;
+}
+
+void Wisdom::save_state()
+{
+    try {
+        state_file_.save(state_);
+    }
+    catch (const std::runtime_error& e) {
+        BOOST_LOG_TRIVIAL(error) << "Unable to save state: " << e.what();
     }
 }
 
@@ -15,6 +15,19 @@
 #include <i3ds/server.hpp>
 #include <i3ds/service.hpp>
 #include <i3ds/codec.hpp>
+#include <i3ds/publisher.hpp>
+#include <i3ds/frame.hpp>
+
+#include <fstream>
+
+#include <sys/types.h>
+
+#include "deadline_trigger.hpp"
+#include "radargram_codec.hpp"
+#include "radargram_quicklook.hpp"
+#include "trace_fanout.hpp"
+#include "wisdom_protocol.hpp"
+#include "wisdom_state.hpp"
 
 class Wisdom : public i3ds::Sensor
 {
@@ -25,9 +38,28 @@ class Wisdom : public i3ds::Sensor
         typedef i3ds::Command<17, i3ds::NullCodec> LoadTablesService;
         typedef i3ds::Command<19, i3ds::T_StringCodec> TableSelectService; 
 
+        // Arm the next start to send SCI_START at a time of day. The request
+        // holds the time as 8 little endian bytes of microseconds since the
+        // epoch, or is empty to disarm.
+        typedef i3ds::Command<20, i3ds::T_StringCodec> ArmTriggerService;
+
+        // Decimated radargrams, published coarsest first when a table is done.
+        // Each image row is one decimated trace. Pixels are unsigned 16 bit,
+        // the signed sample plus 32768.
+        typedef i3ds::Topic<130, i3ds::FrameCodec> QuickLookTopic;
+
+        // Number of samples in each radargram trace.
+        static const unsigned int SAMPLES_PER_TRACE = 1024;
+
+        // Number of traces each consumer may fall behind acquisition.
+        static const size_t SINK_QUEUE_SIZE = 1024;
+
         // Constructor
-        Wisdom(i3ds_asn1::NodeID node, unsigned int dummy_delay = 0, std::string uart_dev = "", 
-               std::string port = "", std::string ip = "127.0.0.1");
+        Wisdom(i3ds::Context::Ptr context, i3ds_asn1::NodeID node, unsigned int dummy_delay = 0, std::string uart_dev = "", 
+               std::string port = "", std::string ip = "127.0.0.1", std::string state_file = "",
+               std::string archive_file = "",
+               TraceSink::Policy quicklook_policy = TraceSink::POLICY_DROP_OLDEST,
+               TraceSink::Policy archive_policy = TraceSink::POLICY_DROP_OLDEST);
 
         // Destructor
         virtual ~Wisdom();
@@ -57,22 +89,51 @@ class Wisdom : public i3ds::Sensor
     private:
 
         // UDP communication functions
-        void make_sci_config_cmd(char* buf, unsigned char table_number);
-        void make_sci_start_cmd(char* buf, unsigned char table_number);
-        void send_udp_command(const char* command);
-        void wait_for_ack(const char expected_byte);
+        void send_udp_command(const wisdom_protocol::CommandPacket& command);
+        // Receive one datagram. Returns -1 on timeout, waits until Stop() if
+        // timeout_ms is negative.
+        ssize_t receive_udp(uint8_t* buf, size_t size, int timeout_ms);
+        // Discard all datagrams already received.
+        void drain_udp();
+        // Returns true if the expected ACK was received. Only single byte
+        // datagrams are taken as ACKs, anything else is skipped. Waits until
+        // Stop() if timeout_ms is negative.
+        bool wait_for_ack(wisdom_protocol::CommandId expected, int timeout_ms = -1);
+        // Returns true if HK_REQUEST was answered, by an ACK or by an HK
+        // packet. has_hk is set if hk was decoded from a packet.
+        bool wait_for_housekeeping(wisdom_protocol::Housekeeping& hk, bool& has_hk, int timeout_ms);
 
         void dummy_wait_for_measurement_to_finish();
         void wait_for_measurement_to_finish();
 
+        // Science data handling. Called from the acquisition thread only.
+        void ingest_trace(uint8_t table, uint32_t index, const int16_t* samples);
+        void finish_table(uint8_t table, uint32_t n_traces);
+
+        // Trace consumers, each called from its own sink thread.
+        void consume_quicklook(const Trace& trace);
+        void consume_archive(const Trace& trace);
+
+        void publish_quicklook();
+
         // Command handlers
         void handle_set_time(SetTimeService::Data);
         void handle_load_tables(LoadTablesService::Data);
         void handle_table_select(TableSelectService::Data);
+        void handle_arm_trigger(ArmTriggerService::Data);
+
+        // Wait for an armed trigger and call fire at the trigger time, or at
+        // once if none is armed. Returns false, without calling fire, if the
+        // wait was cancelled by Stop() or do_stop().
+        bool wait_for_trigger(const std::function<void()>& fire);
 
         void set_time();
         void load_tables();
 
+        // Warm restart
+        bool verify_restored_state();
+        void save_state();
+
         bool send_serial_cmd(const char* cmd, const size_t cmd_len, const char* expected_ack);
         bool power_on();
         bool power_off();
@@ -88,20 +149,42 @@ class Wisdom : public i3ds::Sensor
         int udp_socket_;
         struct addrinfo *wisdom_addr_;
 
-        // UDP message commands
-        static const unsigned int CMD_LEN = 4;
-        const char SCI_CONFIG[CMD_LEN] = {1, 0, 0, 0};
-        const char HK_REQUEST[CMD_LEN] = {2, 0, 0, 0};
-        const char SCI_START[CMD_LEN] = {3, 0, 0, 3};
-        const char SCI_REQUEST[CMD_LEN] = {4, 0, 0, 0};
-        const char SET_TIME[CMD_LEN] = {7, 0, 0, 0};
-
         // Flags for which parameter tables to use
         static const unsigned int N_TABLES = 4;
         bool active_tables_[N_TABLES] = {true, true, true, true};
 
         std::atomic<bool> running_;
 
+        // Time of day in microseconds to start the next measurement, 0 if
+        // not armed.
+        std::atomic<int64_t> trigger_time_;
+        DeadlineTrigger trigger_;
+
+        // Set while the worker waits for the armed trigger. Whoever clears
+        // it first, the trigger firing or do_stop(), decides whether the
+        // measurement runs.
+        std::atomic<bool> waiting_for_trigger_;
+
+        // Quick-look products
+        i3ds::Publisher publisher_;
+        QuickLookPyramid quicklook_;
+
+        // Compressed archive of full resolution traces
+        std::ofstream archive_;
+        RadargramEncoder archive_encoder_;
+        std::vector<uint8_t> archive_buffer_;
+
+        // Must be declared after the members used by the consumers, so
+        // that the sink threads are stopped first.
+        TraceFanout fanout_;
+
+        // Instrument state persisted across restarts
+        WisdomStateFile state_file_;
+        WisdomState state_;
+        bool state_restored_;
+        static const int64_t TIME_SYNC_MAX_AGE_US = 3600LL * 1000000;
+        static const int HK_TIMEOUT_MS = 2000;
+
         // Serial communication
         int serial_port_;
         const unsigned int serial_retries_ = 5;
@@ -0,0 +1,471 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2022 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __WISDOM_PROTOCOL_HPP
+#define __WISDOM_PROTOCOL_HPP
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define WISDOM_CRC32C_X86 1
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#define WISDOM_CRC32C_ARM 1
+#include <arm_acle.h>
+#endif
+
+// Typed encoders and decoders for the UDP protocol of the WISDOM server.
+//
+// Commands are fixed size packets of COMMAND_SIZE bytes, and are answered
+// with an ACK byte echoing the command ID. This is the only part taken from
+// the behaviour of the WISDOM server.
+//
+// PROVISIONAL: the framing below for housekeeping and science data, and the
+// HK payload layout further down, are not taken from the interface document
+// of the instrument. They are placeholders for tests and for the emulator in
+// wisdom_ack_service, and must be replaced once the real format is known.
+//
+//   sync[2] type[1] flags[1] sequence[2] count[2] length[2] payload[length] crc32c[4]
+//
+// Multi-byte fields are little endian, and the CRC covers header and payload.
+// A science frame larger than MAX_PAYLOAD is split in count packets that all
+// except the last carry exactly MAX_PAYLOAD bytes.
+//
+// Nothing in this file allocates, so it can be used on the acquisition path.
+namespace wisdom_protocol
+{
+
+////////////////////////////////////////////////////////////////////////////////
+/// CRC32C (Castagnoli)
+////////////////////////////////////////////////////////////////////////////////
+
+namespace detail
+{
+
+struct Crc32cTable
+{
+    uint32_t t[8][256];
+
+    Crc32cTable() : t()
+    {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c >> 1) ^ (0x82F63B78u & (0u - (c & 1)));
+            }
+            t[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; i++) {
+            for (int s = 1; s < 8; s++) {
+                t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xFF];
+            }
+        }
+    }
+};
+
+inline const Crc32cTable& crc32c_table()
+{
+    static const Crc32cTable table;
+    return table;
+}
+
+inline uint64_t load_u64(const uint8_t* p)
+{
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+#ifdef WISDOM_CRC32C_X86
+__attribute__((target("sse4.2")))
+inline uint32_t crc32c_update_sse42(uint32_t crc, const uint8_t* data, size_t size)
+{
+    uint64_t c = crc;
+    for (; size >= 8; size -= 8, data += 8) {
+        c = _mm_crc32_u64(c, load_u64(data));
+    }
+    uint32_t c32 = static_cast<uint32_t>(c);
+    for (; size > 0; size--) {
+        c32 = _mm_crc32_u8(c32, *data++);
+    }
+    return c32;
+}
+
+inline bool has_sse42()
+{
+    static const bool supported = __builtin_cpu_supports("sse4.2");
+    return supported;
+}
+#endif
+
+#ifdef WISDOM_CRC32C_ARM
+inline uint32_t crc32c_update_arm(uint32_t crc, const uint8_t* data, size_t size)
+{
+    for (; size >= 8; size -= 8, data += 8) {
+        crc = __crc32cd(crc, load_u64(data));
+    }
+    for (; size > 0; size--) {
+        crc = __crc32cb(crc, *data++);
+    }
+    return crc;
+}
+#endif
+
+} // namespace detail
+
+// Portable slice-by-8 implementation, works on any little or big endian host.
+inline uint32_t crc32c_update_software(uint32_t crc, const uint8_t* data, size_t size)
+{
+    const detail::Crc32cTable& tab = detail::crc32c_table();
+    for (; size >= 8; size -= 8, data += 8) {
+        const uint32_t lo = crc ^ (data[0] | (data[1] << 8) | (data[2] << 16) | (static_cast<uint32_t>(data[3]) << 24));
+        crc = tab.t[7][lo & 0xFF] ^ tab.t[6][(lo >> 8) & 0xFF] ^ tab.t[5][(lo >> 16) & 0xFF] ^ tab.t[4][lo >> 24]
+              ^ tab.t[3][data[4]] ^ tab.t[2][data[5]] ^ tab.t[1][data[6]] ^ tab.t[0][data[7]];
+    }
+    for (; size > 0; size--) {
+        crc = (crc >> 8) ^ tab.t[0][(crc ^ *data++) & 0xFF];
+    }
+    return crc;
+}
+
+// Update a running CRC with the fastest implementation available on the host.
+// Start with crc32c_update(~0u, ...) and invert the final value, or use crc32c().
+inline uint32_t crc32c_update(uint32_t crc, const uint8_t* data, size_t size)
+{
+#if defined(WISDOM_CRC32C_X86)
+    if (detail::has_sse42()) {
+        return detail::crc32c_update_sse42(crc, data, size);
+    }
+#elif defined(WISDOM_CRC32C_ARM)
+    return detail::crc32c_update_arm(crc, data, size);
+#endif
+    return crc32c_update_software(crc, data, size);
+}
+
+inline uint32_t crc32c(const uint8_t* data, size_t size)
+{
+    return ~crc32c_update(~0u, data, size);
+}
+
+// True if crc32c() uses a hardware instruction on this host.
+inline bool crc32c_hardware_accelerated()
+{
+#if defined(WISDOM_CRC32C_X86)
+    return detail::has_sse42();
+#elif defined(WISDOM_CRC32C_ARM)
+    return true;
+#else
+    return false;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Commands and ACKs
+////////////////////////////////////////////////////////////////////////////////
+
+enum CommandId : uint8_t
+{
+    SCI_CONFIG = 1,
+    HK_REQUEST = 2,
+    SCI_START = 3,
+    SCI_REQUEST = 4,
+    SET_TIME = 7
+};
+
+static const size_t COMMAND_SIZE = 4;
+static const size_t ACK_SIZE = 1;
+
+typedef std::array<uint8_t, COMMAND_SIZE> CommandPacket;
+
+// Compile-time definition of a command. The argument byte holds the table
+// number for table commands and is 0 otherwise.
+template <CommandId ID, uint8_t TRAILER = 0>
+struct Command
+{
+    static const CommandId id = ID;
+
+    static CommandPacket Encode(uint8_t argument = 0)
+    {
+        return CommandPacket{{ID, argument, 0, TRAILER}};
+    }
+};
+
+typedef Command<SCI_CONFIG> SciConfig;
+typedef Command<HK_REQUEST> HkRequest;
+typedef Command<SCI_START, 3> SciStart;
+typedef Command<SCI_REQUEST> SciRequest;
+typedef Command<SET_TIME> SetTime;
+
+enum DecodeStatus
+{
+    DECODE_OK = 0,
+    DECODE_TRUNCATED,
+    DECODE_BAD_LENGTH,
+    DECODE_BAD_SYNC,
+    DECODE_BAD_TYPE,
+    DECODE_BAD_SEQUENCE,
+    DECODE_BAD_CRC,
+    DECODE_UNEXPECTED
+};
+
+inline const char* to_string(DecodeStatus status)
+{
+    switch (status) {
+        case DECODE_OK: return "ok";
+        case DECODE_TRUNCATED: return "truncated";
+        case DECODE_BAD_LENGTH: return "bad length";
+        case DECODE_BAD_SYNC: return "bad sync";
+        case DECODE_BAD_TYPE: return "bad type";
+        case DECODE_BAD_SEQUENCE: return "bad sequence";
+        case DECODE_BAD_CRC: return "bad CRC";
+        case DECODE_UNEXPECTED: return "unexpected";
+    }
+    return "unknown";
+}
+
+// Check that an ACK datagram acknowledges the expected command.
+inline DecodeStatus decode_ack(const uint8_t* data, size_t size, CommandId expected)
+{
+    if (size < ACK_SIZE) {
+        return DECODE_TRUNCATED;
+    }
+    if (size > ACK_SIZE) {
+        return DECODE_BAD_LENGTH;
+    }
+    return data[0] == expected ? DECODE_OK : DECODE_UNEXPECTED;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Framed HK and science packets
+////////////////////////////////////////////////////////////////////////////////
+
+enum PacketType : uint8_t
+{
+    PACKET_HK = HK_REQUEST,
+    PACKET_SCIENCE = SCI_REQUEST
+};
+
+static const uint8_t SYNC[2] = {'W', 'S'};
+static const size_t PACKET_HEADER_SIZE = 10;
+static const size_t PACKET_CRC_SIZE = 4;
+static const size_t MAX_PAYLOAD = 1400;
+static const size_t MAX_PACKET_SIZE = PACKET_HEADER_SIZE + MAX_PAYLOAD + PACKET_CRC_SIZE;
+
+// Decoded packet. The payload points into the buffer that was decoded.
+struct PacketView
+{
+    PacketType type;
+    uint8_t flags;
+    uint16_t sequence;
+    uint16_t count;
+    const uint8_t* payload;
+    uint16_t length;
+};
+
+namespace detail
+{
+
+inline void put_u16(uint8_t* p, uint16_t v)
+{
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+}
+
+inline uint16_t get_u16(const uint8_t* p)
+{
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+inline void put_u32(uint8_t* p, uint32_t v)
+{
+    put_u16(p, static_cast<uint16_t>(v));
+    put_u16(p + 2, static_cast<uint16_t>(v >> 16));
+}
+
+inline uint32_t get_u32(const uint8_t* p)
+{
+    return get_u16(p) | (static_cast<uint32_t>(get_u16(p + 2)) << 16);
+}
+
+} // namespace detail
+
+// True if data starts like a framed packet, whether or not it is valid.
+inline bool is_framed(const uint8_t* data, size_t size)
+{
+    return size >= sizeof(SYNC) && data[0] == SYNC[0] && data[1] == SYNC[1];
+}
+
+// Encode a packet into out. Returns the packet size, or 0 if the payload is
+// too large or out cannot hold the packet.
+inline size_t encode_packet(PacketType type, uint16_t sequence, uint16_t count,
+                            const uint8_t* payload, size_t length,
+                            uint8_t* out, size_t out_size, uint8_t flags = 0)
+{
+    const size_t size = PACKET_HEADER_SIZE + length + PACKET_CRC_SIZE;
+    if (length > MAX_PAYLOAD || out_size < size) {
+        return 0;
+    }
+    out[0] = SYNC[0];
+    out[1] = SYNC[1];
+    out[2] = type;
+    out[3] = flags;
+    detail::put_u16(out + 4, sequence);
+    detail::put_u16(out + 6, count);
+    detail::put_u16(out + 8, static_cast<uint16_t>(length));
+    if (length > 0) {
+        std::memcpy(out + PACKET_HEADER_SIZE, payload, length);
+    }
+    detail::put_u32(out + PACKET_HEADER_SIZE + length, crc32c(out, PACKET_HEADER_SIZE + length));
+    return size;
+}
+
+// Decode and verify one packet datagram.
+inline DecodeStatus decode_packet(const uint8_t* data, size_t size, PacketView& packet)
+{
+    if (size < PACKET_HEADER_SIZE + PACKET_CRC_SIZE) {
+        return DECODE_TRUNCATED;
+    }
+    if (data[0] != SYNC[0] || data[1] != SYNC[1]) {
+        return DECODE_BAD_SYNC;
+    }
+    if (data[2] != PACKET_HK && data[2] != PACKET_SCIENCE) {
+        return DECODE_BAD_TYPE;
+    }
+    const uint16_t length = detail::get_u16(data + 8);
+    if (length > MAX_PAYLOAD || size != PACKET_HEADER_SIZE + length + PACKET_CRC_SIZE) {
+        return DECODE_BAD_LENGTH;
+    }
+    const uint16_t sequence = detail::get_u16(data + 4);
+    const uint16_t count = detail::get_u16(data + 6);
+    if (count == 0 || sequence >= count) {
+        return DECODE_BAD_SEQUENCE;
+    }
+    if (crc32c(data, PACKET_HEADER_SIZE + length) != detail::get_u32(data + PACKET_HEADER_SIZE + length)) {
+        return DECODE_BAD_CRC;
+    }
+
+    packet.type = static_cast<PacketType>(data[2]);
+    packet.flags = data[3];
+    packet.sequence = sequence;
+    packet.count = count;
+    packet.payload = data + PACKET_HEADER_SIZE;
+    packet.length = length;
+    return DECODE_OK;
+}
+
+// Leading fields of the HK payload, little endian. PROVISIONAL, see above:
+//
+//   uptime[4] status[1]
+//
+// uptime is in seconds since WISDOM was powered on. Any further fields are
+// ignored.
+static const size_t HK_MIN_LENGTH = 5;
+static const uint8_t HK_STATUS_TABLES_LOADED = 0x01;
+
+struct Housekeeping
+{
+    uint32_t uptime_s;
+    bool tables_loaded;
+};
+
+// Encode a single packet HK reply into out. Returns the packet size, or 0
+// if out cannot hold it.
+inline size_t encode_housekeeping(const Housekeeping& hk, uint8_t* out, size_t out_size)
+{
+    uint8_t payload[HK_MIN_LENGTH];
+    detail::put_u32(payload, hk.uptime_s);
+    payload[4] = hk.tables_loaded ? HK_STATUS_TABLES_LOADED : 0;
+    return encode_packet(PACKET_HK, 0, 1, payload, sizeof(payload), out, out_size);
+}
+
+// Decode the HK fields of a packet verified by decode_packet.
+inline DecodeStatus decode_housekeeping(const PacketView& packet, Housekeeping& hk)
+{
+    if (packet.type != PACKET_HK) {
+        return DECODE_BAD_TYPE;
+    }
+    if (packet.count != 1) {
+        return DECODE_BAD_SEQUENCE;
+    }
+    if (packet.length < HK_MIN_LENGTH) {
+        return DECODE_BAD_LENGTH;
+    }
+    hk.uptime_s = detail::get_u32(packet.payload);
+    hk.tables_loaded = (packet.payload[4] & HK_STATUS_TABLES_LOADED) != 0;
+    return DECODE_OK;
+}
+
+// Reassembles a multi-packet science frame of at most MAX_PACKETS packets
+// into a fixed buffer. Packets may arrive in any order, duplicates are
+// ignored.
+template <size_t MAX_PACKETS>
+class FrameAssembler
+{
+public:
+
+    static const size_t CAPACITY = MAX_PACKETS * MAX_PAYLOAD;
+
+    FrameAssembler() : count_(0), size_(0) {}
+
+    void reset()
+    {
+        received_.reset();
+        count_ = 0;
+        size_ = 0;
+    }
+
+    // Add a decoded science packet to the frame.
+    DecodeStatus add(const PacketView& packet)
+    {
+        if (packet.type != PACKET_SCIENCE) {
+            return DECODE_BAD_TYPE;
+        }
+        if (packet.count > MAX_PACKETS || (count_ != 0 && packet.count != count_)) {
+            return DECODE_BAD_SEQUENCE;
+        }
+        const bool last = packet.sequence + 1 == packet.count;
+        if ((!last && packet.length != MAX_PAYLOAD) || (last && packet.length == 0 && packet.count > 1)) {
+            return DECODE_BAD_LENGTH;
+        }
+        count_ = packet.count;
+        if (received_.test(packet.sequence)) {
+            return DECODE_OK;
+        }
+        std::memcpy(buffer_ + packet.sequence * MAX_PAYLOAD, packet.payload, packet.length);
+        received_.set(packet.sequence);
+        if (last) {
+            size_ = packet.sequence * MAX_PAYLOAD + packet.length;
+        }
+        return DECODE_OK;
+    }
+
+    bool complete() const {return count_ != 0 && received_.count() == count_;}
+
+    // Number of packets still missing, 0 if the frame count is not known yet.
+    size_t missing() const {return count_ - received_.count();}
+
+    const uint8_t* data() const {return buffer_;}
+    size_t size() const {return size_;}
+
+private:
+
+    uint8_t buffer_[CAPACITY];
+    std::bitset<MAX_PACKETS> received_;
+    uint16_t count_;
+    size_t size_;
+};
+
+} // namespace wisdom_protocol
+
+#endif
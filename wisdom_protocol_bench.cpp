@@ -0,0 +1,247 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2022 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+// Microbenchmarks and fuzz tests for wisdom_protocol.hpp. Returns non-zero
+// if any of the checks fail.
+
+#include "wisdom_protocol.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace wp = wisdom_protocol;
+
+namespace
+{
+
+// Keeps the optimizer from removing benchmarked work.
+volatile uint64_t sink;
+
+int failures = 0;
+
+void check(bool ok, const char* what)
+{
+    if (!ok) {
+        std::printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+template <typename F>
+void bench(const char* name, size_t iterations, size_t bytes_per_iteration, F f)
+{
+    // Warm up caches and the CPU feature dispatch.
+    for (size_t i = 0; i < iterations / 10 + 1; i++) {
+        f(i);
+    }
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        f(i);
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::printf("%-32s %10.1f ns/op", name, 1e9 * seconds / iterations);
+    if (bytes_per_iteration > 0) {
+        std::printf(" %10.1f MB/s", 1e-6 * bytes_per_iteration * iterations / seconds);
+    }
+    std::printf("\n");
+}
+
+void test_crc()
+{
+    const uint8_t check_input[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    check(wp::crc32c(check_input, sizeof(check_input)) == 0xE3069283u, "CRC32C check value");
+
+    std::mt19937 rng(1);
+    std::vector<uint8_t> data(4099);
+    for (uint8_t& b : data) {
+        b = static_cast<uint8_t>(rng());
+    }
+    for (size_t offset = 0; offset < 8; offset++) {
+        for (size_t size = 0; size < 64; size++) {
+            const uint32_t hw = wp::crc32c_update(~0u, data.data() + offset, size);
+            const uint32_t sw = wp::crc32c_update_software(~0u, data.data() + offset, size);
+            check(hw == sw, "CRC32C hardware and software agree");
+        }
+    }
+
+    // Incremental update must equal a single pass.
+    const uint32_t split = ~wp::crc32c_update(wp::crc32c_update(~0u, data.data(), 1000),
+                                              data.data() + 1000, data.size() - 1000);
+    check(split == wp::crc32c(data.data(), data.size()), "CRC32C incremental update");
+}
+
+void test_commands()
+{
+    const wp::CommandPacket start = wp::SciStart::Encode(2);
+    check(start[0] == 3 && start[1] == 2 && start[2] == 0 && start[3] == 3, "SCI_START encoding");
+
+    const wp::CommandPacket config = wp::SciConfig::Encode(4);
+    check(config[0] == 1 && config[1] == 4 && config[2] == 0 && config[3] == 0, "SCI_CONFIG encoding");
+
+    const uint8_t ack = wp::SET_TIME;
+    check(wp::decode_ack(&ack, 1, wp::SET_TIME) == wp::DECODE_OK, "ACK accepted");
+    check(wp::decode_ack(&ack, 1, wp::SCI_START) == wp::DECODE_UNEXPECTED, "Wrong ACK rejected");
+    check(wp::decode_ack(&ack, 0, wp::SET_TIME) == wp::DECODE_TRUNCATED, "Empty ACK rejected");
+}
+
+void test_packets(size_t iterations)
+{
+    std::mt19937 rng(2);
+    std::vector<uint8_t> payload(wp::MAX_PAYLOAD);
+    uint8_t packet[wp::MAX_PACKET_SIZE];
+    wp::PacketView view = {};
+
+    // Round trip with random lengths.
+    for (size_t i = 0; i < iterations; i++) {
+        const size_t length = rng() % (wp::MAX_PAYLOAD + 1);
+        for (size_t j = 0; j < length; j++) {
+            payload[j] = static_cast<uint8_t>(rng());
+        }
+        const size_t size = wp::encode_packet(wp::PACKET_HK, 0, 1, payload.data(), length, packet, sizeof(packet));
+        check(size == wp::PACKET_HEADER_SIZE + length + wp::PACKET_CRC_SIZE, "Packet encoded");
+        check(wp::decode_packet(packet, size, view) == wp::DECODE_OK, "Packet round trip");
+        check(view.length == length && std::memcmp(view.payload, payload.data(), length) == 0, "Packet payload");
+    }
+
+    // Every single bit flip must be rejected.
+    const size_t size = wp::encode_packet(wp::PACKET_SCIENCE, 3, 7, payload.data(), 256, packet, sizeof(packet));
+    for (size_t bit = 0; bit < 8 * size; bit++) {
+        packet[bit / 8] ^= 1 << (bit % 8);
+        check(wp::decode_packet(packet, size, view) != wp::DECODE_OK, "Bit flip detected");
+        packet[bit / 8] ^= 1 << (bit % 8);
+    }
+
+    // Random and truncated input must never be accepted nor read out of bounds.
+    std::vector<uint8_t> junk;
+    for (size_t i = 0; i < iterations; i++) {
+        junk.resize(rng() % (wp::MAX_PACKET_SIZE + 16));
+        for (uint8_t& b : junk) {
+            b = static_cast<uint8_t>(rng());
+        }
+        if (junk.size() >= 3 && (i & 1)) {
+            junk[0] = wp::SYNC[0];
+            junk[1] = wp::SYNC[1];
+            junk[2] = wp::PACKET_SCIENCE;
+        }
+        check(wp::decode_packet(junk.data(), junk.size(), view) != wp::DECODE_OK, "Random packet rejected");
+        check(wp::decode_packet(packet, rng() % size, view) != wp::DECODE_OK, "Truncated packet rejected");
+    }
+
+    // Housekeeping fields.
+    const wp::Housekeeping hk = {123456789, true};
+    wp::Housekeeping decoded = {};
+    const size_t hk_size = wp::encode_housekeeping(hk, packet, sizeof(packet));
+    check(wp::decode_packet(packet, hk_size, view) == wp::DECODE_OK
+          && wp::decode_housekeeping(view, decoded) == wp::DECODE_OK
+          && decoded.uptime_s == hk.uptime_s && decoded.tables_loaded, "Housekeeping round trip");
+    check(wp::decode_packet(packet, wp::encode_packet(wp::PACKET_HK, 0, 1, payload.data(), wp::HK_MIN_LENGTH - 1,
+                                                      packet, sizeof(packet)), view) == wp::DECODE_OK
+          && wp::decode_housekeeping(view, decoded) == wp::DECODE_BAD_LENGTH, "Short housekeeping rejected");
+}
+
+void test_frames()
+{
+    static wp::FrameAssembler<64> assembler;
+    std::mt19937 rng(3);
+
+    std::vector<uint8_t> frame(10 * wp::MAX_PAYLOAD + 123);
+    for (uint8_t& b : frame) {
+        b = static_cast<uint8_t>(rng());
+    }
+    const uint16_t count = static_cast<uint16_t>((frame.size() + wp::MAX_PAYLOAD - 1) / wp::MAX_PAYLOAD);
+
+    std::vector<std::vector<uint8_t>> packets(count, std::vector<uint8_t>(wp::MAX_PACKET_SIZE));
+    for (uint16_t seq = 0; seq < count; seq++) {
+        const size_t offset = seq * wp::MAX_PAYLOAD;
+        const size_t length = std::min(wp::MAX_PAYLOAD, frame.size() - offset);
+        packets[seq].resize(wp::encode_packet(wp::PACKET_SCIENCE, seq, count, frame.data() + offset,
+                                              length, packets[seq].data(), packets[seq].size()));
+    }
+
+    // Deliver out of order with duplicates.
+    std::shuffle(packets.begin(), packets.end(), rng);
+    packets.push_back(packets.front());
+
+    wp::PacketView view = {};
+    for (const std::vector<uint8_t>& p : packets) {
+        check(wp::decode_packet(p.data(), p.size(), view) == wp::DECODE_OK, "Frame packet decoded");
+        check(assembler.add(view) == wp::DECODE_OK, "Frame packet accepted");
+    }
+    check(assembler.complete(), "Frame complete");
+    check(assembler.size() == frame.size() && std::memcmp(assembler.data(), frame.data(), frame.size()) == 0,
+          "Frame reassembled");
+}
+
+void run_benchmarks(size_t iterations)
+{
+    std::printf("CRC32C hardware accelerated: %s\n", wp::crc32c_hardware_accelerated() ? "yes" : "no");
+
+    std::vector<uint8_t> data(64 * 1024);
+    std::mt19937 rng(4);
+    for (uint8_t& b : data) {
+        b = static_cast<uint8_t>(rng());
+    }
+
+    bench("encode SCI_START", iterations, 0, [](size_t i) {
+        sink = wp::SciStart::Encode(static_cast<uint8_t>(i))[1];
+    });
+    bench("decode ACK", iterations, 0, [](size_t i) {
+        const uint8_t ack = static_cast<uint8_t>(i);
+        sink = wp::decode_ack(&ack, 1, wp::SCI_START);
+    });
+    bench("crc32c 1400 B", iterations / 10, wp::MAX_PAYLOAD, [&](size_t) {
+        sink = wp::crc32c(data.data(), wp::MAX_PAYLOAD);
+    });
+    bench("crc32c software 1400 B", iterations / 10, wp::MAX_PAYLOAD, [&](size_t) {
+        sink = wp::crc32c_update_software(~0u, data.data(), wp::MAX_PAYLOAD);
+    });
+    bench("crc32c 64 kB", iterations / 500, data.size(), [&](size_t) {
+        sink = wp::crc32c(data.data(), data.size());
+    });
+
+    uint8_t packet[wp::MAX_PACKET_SIZE];
+    const size_t size = wp::encode_packet(wp::PACKET_SCIENCE, 0, 1, data.data(), wp::MAX_PAYLOAD,
+                                          packet, sizeof(packet));
+    bench("encode science packet", iterations / 10, wp::MAX_PAYLOAD, [&](size_t i) {
+        sink = wp::encode_packet(wp::PACKET_SCIENCE, 0, 1, data.data() + (i & 7), wp::MAX_PAYLOAD,
+                                 packet, sizeof(packet));
+    });
+    wp::encode_packet(wp::PACKET_SCIENCE, 0, 1, data.data(), wp::MAX_PAYLOAD, packet, sizeof(packet));
+    bench("decode science packet", iterations / 10, wp::MAX_PAYLOAD, [&](size_t) {
+        wp::PacketView view;
+        sink = wp::decode_packet(packet, size, view);
+    });
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+    test_crc();
+    test_commands();
+    test_packets(iterations / 100);
+    test_frames();
+
+    if (failures > 0) {
+        std::printf("%d checks failed\n", failures);
+        return 1;
+    }
+    std::printf("All checks passed\n");
+
+    run_benchmarks(iterations);
+    return 0;
+}
@@ -0,0 +1,112 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2022 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#include "wisdom_script.hpp"
+
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+
+// Expected number of arguments for each command, -1 for zero or one.
+int n_args(const std::string& command)
+{
+    if (command == "activate" || command == "start" || command == "stop" || command == "deactivate"
+        || command == "set-time" || command == "load-tables" || command == "print" || command == "end") {
+        return 0;
+    }
+    if (command == "arm-at" || command == "arm-in" || command == "sleep" || command == "repeat") {
+        return 1;
+    }
+    if (command == "set-tables") {
+        return 4;
+    }
+    if (command == "wait-standby") {
+        return -1;
+    }
+    throw std::invalid_argument("Unknown command: " + command);
+}
+
+long long to_number(const std::string& arg, unsigned int line)
+{
+    size_t used = 0;
+    long long value = 0;
+    try {
+        value = std::stoll(arg, &used);
+    }
+    catch (const std::exception&) {
+        used = 0;
+    }
+    if (used != arg.size()) {
+        throw std::invalid_argument("Line " + std::to_string(line) + ": expected a number, got " + arg);
+    }
+    return value;
+}
+
+} // namespace
+
+WisdomScript::WisdomScript(std::istream& input)
+{
+    std::vector<size_t> open_repeats;
+    std::string text;
+    unsigned int line = 0;
+
+    while (std::getline(input, text)) {
+        line++;
+        text = text.substr(0, text.find('#'));
+
+        std::istringstream tokens(text);
+        Step step;
+        if (!(tokens >> step.command)) {
+            continue;
+        }
+        step.line = line;
+        step.end = 0;
+        for (std::string arg; tokens >> arg;) {
+            step.args.push_back(arg);
+        }
+
+        int expected;
+        try {
+            expected = n_args(step.command);
+        }
+        catch (const std::invalid_argument& e) {
+            throw std::invalid_argument("Line " + std::to_string(line) + ": " + e.what());
+        }
+        if ((expected >= 0 && step.args.size() != static_cast<size_t>(expected))
+            || (expected < 0 && step.args.size() > 1)) {
+            throw std::invalid_argument("Line " + std::to_string(line) + ": wrong number of arguments to "
+                                        + step.command);
+        }
+        for (const std::string& arg : step.args) {
+            if (to_number(arg, line) < 0) {
+                throw std::invalid_argument("Line " + std::to_string(line) + ": negative argument");
+            }
+        }
+
+        if (step.command == "repeat") {
+            open_repeats.push_back(steps_.size());
+        }
+        else if (step.command == "end") {
+            if (open_repeats.empty()) {
+                throw std::invalid_argument("Line " + std::to_string(line) + ": end without repeat");
+            }
+            steps_[open_repeats.back()].end = steps_.size();
+            open_repeats.pop_back();
+        }
+        steps_.push_back(step);
+    }
+
+    if (!open_repeats.empty()) {
+        throw std::invalid_argument("Line " + std::to_string(steps_[open_repeats.back()].line)
+                                    + ": repeat without end");
+    }
+}
@@ -0,0 +1,69 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2022 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __WISDOM_SCRIPT_HPP
+#define __WISDOM_SCRIPT_HPP
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class WisdomClient;
+
+// Sequence of commands executed over a single WisdomClient connection.
+//
+// One command per line, blank lines and text after '#' are ignored:
+//
+//   activate | start | stop | deactivate
+//   set-time | load-tables | print
+//   set-tables <b1> <b2> <b3> <b4>
+//   arm-at <us since epoch> | arm-in <ms>
+//   wait-standby [timeout s]   (default 600 s)
+//   sleep <ms>
+//   repeat <n>
+//     ...
+//   end
+//
+// The time spent on every step is written to the output stream.
+class WisdomScript
+{
+public:
+
+    // Parse a script, throws std::invalid_argument on syntax errors.
+    WisdomScript(std::istream& input);
+
+    // Run the script. Stops at, and rethrows, the first failing step.
+    void run(WisdomClient& wisdom, std::ostream& out) const;
+
+    struct Step
+    {
+        unsigned int line;
+        std::string command;
+        std::vector<std::string> args;
+
+        // Index of the matching end for repeat.
+        size_t end;
+    };
+
+    // Parsed steps in script order, including repeat and end.
+    const std::vector<Step>& steps() const {return steps_;}
+
+private:
+
+    void run_block(WisdomClient& wisdom, std::ostream& out, size_t first, size_t last,
+                   const std::string& prefix) const;
+
+    void run_step(WisdomClient& wisdom, std::ostream& out, const Step& step) const;
+
+    std::vector<Step> steps_;
+};
+
+#endif
@@ -0,0 +1,146 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2022 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+// Execution of parsed scripts, kept apart from the parser so that the
+// parser can be built and tested without i3ds.
+
+#include "wisdom_script.hpp"
+#include "wisdom_client.hpp"
+#include "deadline_trigger.hpp"
+
+#include <chrono>
+#include <iomanip>
+#include <stdexcept>
+#include <thread>
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+double elapsed_ms(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+const char* state_name(i3ds_asn1::SensorState state)
+{
+    switch (state) {
+        case i3ds_asn1::SensorState_inactive: return "inactive";
+        case i3ds_asn1::SensorState_standby: return "standby";
+        case i3ds_asn1::SensorState_operational: return "operational";
+        case i3ds_asn1::SensorState_failure: return "failure";
+    }
+    return "unknown";
+}
+
+} // namespace
+
+void WisdomScript::run(WisdomClient& wisdom, std::ostream& out) const
+{
+    const Clock::time_point start = Clock::now();
+    run_block(wisdom, out, 0, steps_.size(), "");
+    out << "Script done in " << std::fixed << std::setprecision(3) << elapsed_ms(start) << " ms" << std::endl;
+}
+
+void WisdomScript::run_block(WisdomClient& wisdom, std::ostream& out, size_t first, size_t last,
+                             const std::string& prefix) const
+{
+    for (size_t i = first; i < last; i++) {
+        const Step& step = steps_[i];
+
+        if (step.command == "repeat") {
+            const long long n = std::stoll(step.args[0]);
+            const Clock::time_point start = Clock::now();
+            for (long long r = 0; r < n; r++) {
+                run_block(wisdom, out, i + 1, step.end, prefix + "[" + std::to_string(r + 1) + "] ");
+            }
+            out << prefix << "line " << step.line << ": repeat " << n << " "
+                << std::fixed << std::setprecision(3) << elapsed_ms(start) << " ms" << std::endl;
+            i = step.end;
+            continue;
+        }
+
+        const Clock::time_point start = Clock::now();
+        try {
+            run_step(wisdom, out, step);
+        }
+        catch (const std::exception& e) {
+            out << prefix << "line " << step.line << ": " << step.command << " failed: " << e.what() << std::endl;
+            throw;
+        }
+        out << prefix << "line " << step.line << ": " << step.command;
+        for (const std::string& arg : step.args) {
+            out << " " << arg;
+        }
+        out << " " << std::fixed << std::setprecision(3) << elapsed_ms(start) << " ms" << std::endl;
+    }
+}
+
+void WisdomScript::run_step(WisdomClient& wisdom, std::ostream& out, const Step& step) const
+{
+    const std::string& c = step.command;
+
+    if (c == "activate") {
+        wisdom.Activate();
+    }
+    else if (c == "start") {
+        wisdom.Start();
+    }
+    else if (c == "stop") {
+        wisdom.Stop();
+    }
+    else if (c == "deactivate") {
+        wisdom.Deactivate();
+    }
+    else if (c == "set-time") {
+        wisdom.set_time();
+    }
+    else if (c == "load-tables") {
+        wisdom.load_tables();
+    }
+    else if (c == "set-tables") {
+        std::vector<bool> tables;
+        for (const std::string& arg : step.args) {
+            tables.push_back(std::stoll(arg) != 0);
+        }
+        wisdom.table_select(tables);
+    }
+    else if (c == "arm-at") {
+        wisdom.arm_trigger(std::stoll(step.args[0]));
+    }
+    else if (c == "arm-in") {
+        wisdom.arm_trigger(DeadlineTrigger::now() + 1000 * std::stoll(step.args[0]));
+    }
+    else if (c == "sleep") {
+        std::this_thread::sleep_for(std::chrono::milliseconds(std::stoll(step.args[0])));
+    }
+    else if (c == "print") {
+        wisdom.load_status();
+        out << "State: " << state_name(wisdom.state()) << std::endl;
+    }
+    else if (c == "wait-standby") {
+        const long long timeout_s = step.args.empty() ? 600 : std::stoll(step.args[0]);
+        const Clock::time_point deadline = Clock::now() + std::chrono::seconds(timeout_s);
+        for (;;) {
+            wisdom.load_status();
+            if (wisdom.state() == i3ds_asn1::SensorState_standby) {
+                break;
+            }
+            if (wisdom.state() == i3ds_asn1::SensorState_failure) {
+                throw std::runtime_error("WISDOM is in failure state");
+            }
+            if (Clock::now() >= deadline) {
+                throw std::runtime_error("Timeout waiting for standby");
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+}
@@ -0,0 +1,161 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2022 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+// Checks of the batch script parser on valid and malformed scripts. Returns
+// non-zero if any of the checks fail.
+
+#include "wisdom_script.hpp"
+
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+
+int failures = 0;
+
+void check(bool ok, const char* what)
+{
+    if (!ok) {
+        std::printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+// Parse text, returning the number of steps, or -1 if it was rejected. The
+// error message is kept in error.
+int parse(const std::string& text, std::string& error)
+{
+    std::istringstream input(text);
+    try {
+        return static_cast<int>(WisdomScript(input).steps().size());
+    }
+    catch (const std::invalid_argument& e) {
+        error = e.what();
+        return -1;
+    }
+}
+
+// True if text is rejected with a message containing expected.
+bool rejects(const std::string& text, const std::string& expected)
+{
+    std::string error;
+    return parse(text, error) < 0 && error.find(expected) != std::string::npos;
+}
+
+void test_comments()
+{
+    std::istringstream input(
+        "# Full line comment\n"
+        "\n"
+        "   \t \n"
+        "activate # trailing comment\n"
+        "set-tables 1 0 1 1#no space before comment\n"
+        "wait-standby\n"
+        "wait-standby 30\n");
+    WisdomScript script(input);
+    const std::vector<WisdomScript::Step>& steps = script.steps();
+
+    check(steps.size() == 4, "Comments and blank lines are skipped");
+    if (steps.size() != 4) {
+        return;
+    }
+    check(steps[0].command == "activate" && steps[0].args.empty() && steps[0].line == 4,
+          "Trailing comment removed, line number kept");
+    check(steps[1].command == "set-tables" && steps[1].args.size() == 4 && steps[1].args[3] == "1",
+          "Comment directly after argument");
+    check(steps[2].args.empty() && steps[3].args.size() == 1, "Optional wait-standby timeout");
+}
+
+void test_nesting()
+{
+    std::istringstream input(
+        "activate\n"
+        "repeat 3\n"
+        "  start\n"
+        "  repeat 2\n"
+        "    sleep 10\n"
+        "  end\n"
+        "  wait-standby\n"
+        "end\n"
+        "deactivate\n");
+    WisdomScript script(input);
+    const std::vector<WisdomScript::Step>& steps = script.steps();
+
+    check(steps.size() == 9, "Nested script step count");
+    if (steps.size() != 9) {
+        return;
+    }
+    check(steps[1].command == "repeat" && steps[1].end == 7, "Outer repeat matches last end");
+    check(steps[3].command == "repeat" && steps[3].end == 5, "Inner repeat matches first end");
+    check(steps[7].command == "end" && steps[8].command == "deactivate", "Steps after the loop");
+
+    std::string error;
+    check(parse("repeat 1\nend\nrepeat 2\nend\n", error) == 4, "Consecutive loops");
+    check(parse("repeat 0\nend\n", error) == 2, "Zero repeats");
+}
+
+void test_unbalanced()
+{
+    check(rejects("activate\nend\n", "Line 2: end without repeat"), "End without repeat");
+    check(rejects("repeat 2\nstart\nend\nend\n", "Line 4: end without repeat"), "Extra end after loop");
+    check(rejects("repeat 2\nstart\n", "Line 1: repeat without end"), "Unterminated repeat");
+    check(rejects("repeat 2\nrepeat 3\nend\n", "Line 1: repeat without end"),
+          "Unterminated outer repeat is reported");
+    check(rejects("repeat 2\nend\nrepeat 3\n", "Line 3: repeat without end"),
+          "Unterminated second repeat is reported");
+}
+
+void test_arguments()
+{
+    check(rejects("start now\n", "wrong number of arguments to start"), "Argument to command without any");
+    check(rejects("end 1\n", "wrong number of arguments to end"), "Argument to end");
+    check(rejects("sleep\n", "wrong number of arguments to sleep"), "Missing argument");
+    check(rejects("repeat\nend\n", "wrong number of arguments to repeat"), "Repeat without count");
+    check(rejects("arm-in 1 2\n", "wrong number of arguments to arm-in"), "Too many arguments");
+    check(rejects("set-tables 1 0 1\n", "wrong number of arguments to set-tables"), "Too few tables");
+    check(rejects("set-tables 1 0 1 1 0\n", "wrong number of arguments to set-tables"), "Too many tables");
+    check(rejects("wait-standby 1 2\n", "wrong number of arguments to wait-standby"), "Two timeouts");
+    check(rejects("activate\nfly\n", "Line 2: Unknown command: fly"), "Unknown command");
+}
+
+void test_numbers()
+{
+    check(rejects("sleep -5\n", "Line 1: negative argument"), "Negative sleep");
+    check(rejects("repeat -1\nend\n", "negative argument"), "Negative repeat");
+    check(rejects("set-tables 1 -1 0 0\n", "negative argument"), "Negative table flag");
+    check(rejects("arm-in soon\n", "expected a number, got soon"), "Non-numeric argument");
+    check(rejects("sleep 10ms\n", "expected a number, got 10ms"), "Trailing characters");
+    check(rejects("wait-standby 1.5\n", "expected a number, got 1.5"), "Fraction");
+    check(rejects("arm-at 99999999999999999999999\n", "expected a number"), "Out of range");
+
+    std::string error;
+    check(parse("arm-at 1650000000000000\nsleep 0\n", error) == 2, "Large and zero arguments");
+}
+
+} // namespace
+
+int main()
+{
+    test_comments();
+    test_nesting();
+    test_unbalanced();
+    test_arguments();
+    test_numbers();
+
+    if (failures > 0) {
+        std::printf("%d checks failed\n", failures);
+        return 1;
+    }
+    std::printf("All checks passed\n");
+    return 0;
+}
@@ -0,0 +1,105 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2022 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#include "wisdom_state.hpp"
+#include "wisdom_protocol.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+namespace
+{
+
+// magic[4] version[2] powered[1] tables_loaded[1] time_set_at[8]
+// last_acquisition_id[4] crc32c[4], all little endian.
+const uint8_t MAGIC[4] = {'W', 'S', 'T', 'F'};
+const uint16_t VERSION = 2;
+const size_t FILE_SIZE = 24;
+
+void put(uint8_t* p, uint64_t v, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        p[i] = static_cast<uint8_t>(v >> (8 * i));
+    }
+}
+
+uint64_t get(const uint8_t* p, size_t n)
+{
+    uint64_t v = 0;
+    for (size_t i = 0; i < n; i++) {
+        v |= static_cast<uint64_t>(p[i]) << (8 * i);
+    }
+    return v;
+}
+
+} // namespace
+
+WisdomStateFile::WisdomStateFile(const std::string& path) : path_(path) {}
+
+bool WisdomStateFile::load(WisdomState& state) const
+{
+    if (!enabled()) {
+        return false;
+    }
+
+    uint8_t buf[FILE_SIZE + 1];
+    int fd = open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    ssize_t n = read(fd, buf, sizeof(buf));
+    close(fd);
+
+    if (n != static_cast<ssize_t>(FILE_SIZE)
+        || std::memcmp(buf, MAGIC, sizeof(MAGIC)) != 0
+        || get(buf + 4, 2) != VERSION
+        || wisdom_protocol::crc32c(buf, FILE_SIZE - 4) != get(buf + FILE_SIZE - 4, 4)) {
+        return false;
+    }
+
+    state.powered = buf[6] != 0;
+    state.tables_loaded = buf[7] != 0;
+    state.time_set_at = static_cast<int64_t>(get(buf + 8, 8));
+    state.last_acquisition_id = static_cast<uint32_t>(get(buf + 16, 4));
+    return true;
+}
+
+void WisdomStateFile::save(const WisdomState& state) const
+{
+    if (!enabled()) {
+        return;
+    }
+
+    uint8_t buf[FILE_SIZE] = {};
+    std::memcpy(buf, MAGIC, sizeof(MAGIC));
+    put(buf + 4, VERSION, 2);
+    buf[6] = state.powered ? 1 : 0;
+    buf[7] = state.tables_loaded ? 1 : 0;
+    put(buf + 8, static_cast<uint64_t>(state.time_set_at), 8);
+    put(buf + 16, state.last_acquisition_id, 4);
+    put(buf + FILE_SIZE - 4, wisdom_protocol::crc32c(buf, FILE_SIZE - 4), 4);
+
+    const std::string tmp_path = path_ + ".tmp";
+    int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open " + tmp_path + ", errno: " + std::to_string(errno));
+    }
+    const bool ok = write(fd, buf, FILE_SIZE) == static_cast<ssize_t>(FILE_SIZE) && fsync(fd) == 0;
+    close(fd);
+
+    if (!ok || rename(tmp_path.c_str(), path_.c_str()) != 0) {
+        throw std::runtime_error("Cannot write " + path_ + ", errno: " + std::to_string(errno));
+    }
+}
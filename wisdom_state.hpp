@@ -0,0 +1,61 @@
+///////////////////////////////////////////////////////////////////////////\file
+///
+///   Copyright 2022 SINTEF AS
+///
+///   This Source Code Form is subject to the terms of the Mozilla
+///   Public License, v. 2.0. If a copy of the MPL was not distributed
+///   with this file, You can obtain one at https://mozilla.org/MPL/2.0/
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __WISDOM_STATE_HPP
+#define __WISDOM_STATE_HPP
+
+#include <cstdint>
+#include <string>
+
+// Instrument state that survives a restart of i3ds_wisdom.
+struct WisdomState
+{
+    // True if WISDOM has been powered on through the serial port.
+    bool powered;
+
+    // True if all parameter tables have been acknowledged by SCI_CONFIG
+    // since power on.
+    bool tables_loaded;
+
+    // Time of day in microseconds when SET_TIME was acknowledged, 0 if the
+    // instrument time has not been set since power on.
+    int64_t time_set_at;
+
+    // Incremented for every measurement that is started.
+    uint32_t last_acquisition_id;
+
+    WisdomState() : powered(false), tables_loaded(false), time_set_at(0), last_acquisition_id(0) {}
+};
+
+// Small checksummed file holding a WisdomState. Saving writes a temporary
+// file that is renamed over the old one, so a crash never leaves a partial
+// state behind.
+class WisdomStateFile
+{
+public:
+
+    // An empty path disables persistence.
+    WisdomStateFile(const std::string& path);
+
+    bool enabled() const {return !path_.empty();}
+
+    // Returns false, leaving state untouched, if the file is missing, has
+    // another version or fails the checksum.
+    bool load(WisdomState& state) const;
+
+    // Throws std::runtime_error if the file cannot be written.
+    void save(const WisdomState& state) const;
+
+private:
+
+    const std::string path_;
+};
+
+#endif